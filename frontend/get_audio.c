@@ -358,6 +358,9 @@ typedef struct get_audio_global_data_struct {
     int     pcmswapbytes;
     int     pcm_is_unsigned_8bit;
     int     pcm_is_ieee_float;
+    int     pcm_bytes_per_sample;
+    void    (*unpack_pcm) (int *sample_buffer, int samples_read);
+    int     split_channels;
     unsigned int num_samples_read;
     FILE   *music_in;
     SNDFILE *snd_file;
@@ -383,6 +386,7 @@ static int lame_decode_fromfile(FILE * fd, short int pcm_l[], short int pcm_r[],
                                 mp3data_struct * mp3data);
 
 
+static int select_unpack_pcm(void);
 static int read_samples_pcm(FILE * musicin, int sample_buffer[2304], int samples_to_read);
 static int read_samples_mp3(lame_t gfp, FILE * musicin, short int mpg123pcm[2][1152]);
 #ifdef LIBSNDFILE
@@ -604,6 +608,7 @@ init_infile(lame_t gfp, char const *inPath)
     global. pcmswapbytes = global_reader.swapbytes;
     global. pcm_is_unsigned_8bit = global_raw_pcm.in_signed == 1 ? 0 : 1;
     global. pcm_is_ieee_float = 0;
+    global. split_channels = 0;
     global. hip = 0;
     global. music_in = 0;
     global. snd_file = 0;
@@ -620,6 +625,13 @@ init_infile(lame_t gfp, char const *inPath)
 #endif
         if (global.snd_file == 0) {
             global. music_in = open_wave_file(gfp, inPath, &enc_delay, &enc_padding);
+            if (global.music_in != NULL && !is_mpeg_file_format(global_reader.input_format)) {
+                if (select_unpack_pcm() < 0) {
+                    /* the format has been reported, nothing can be read */
+                    close_input_file(global.music_in);
+                    global. music_in = NULL;
+                }
+            }
         }
     }
     initPcmBuffer(&global.pcm32, sizeof(int));
@@ -673,6 +685,32 @@ close_infile(void)
 static int
         get_audio_common(lame_t gfp, int buffer[2][1152], short buffer16[2][1152]);
 
+/* if this flag has been set, then we are carefull to read
+ * exactly num_samples and no more.  This is useful for .wav and .aiff
+ * files which have id3 or other tags at the end.  Note that if you
+ * are using LIBSNDFILE, this is not necessary 
+ */
+static int
+limit_samples_to_read(int framesize, unsigned int num_samples)
+{
+    if (global.count_samples_carefully) {
+        unsigned int remaining;
+        if (global.num_samples_read < num_samples) {
+            remaining = num_samples - global.num_samples_read;
+        }
+        else {
+            remaining = 0;
+        }
+        if (remaining < (unsigned int) framesize && 0 != num_samples)
+            /* in case the input is a FIFO (at least it's reproducible with
+               a FIFO) num_samples may be 0 and therefore remaining
+               would be 0, but we need to read some samples, so don't
+               change samples_to_read to the wrong value in this case */
+            return remaining;
+    }
+    return framesize;
+}
+
 /************************************************************************
 *
 * get_audio()
@@ -720,6 +758,51 @@ get_audio16(lame_t gfp, short buffer[2][1152])
         return takePcmBuffer(&global.pcm16, buffer[1], buffer[0], used, 1152);
 }
 
+/*
+  get_split_channels - number of input channels when the input is encoded
+                       in channel pairs (--split-channels), else 0
+*/
+int
+get_split_channels(void)
+{
+    return global.split_channels;
+}
+
+/************************************************************************
+  get_audio_split - read a frame of an input with get_split_channels()
+                    channels.  The samples stay interleaved, so the
+                    encoders of all channel pairs read the same buffer.
+   out: buffer    get_split_channels() * 1152 ints
+returns: samples read per channel
+*/
+int
+get_audio_split(lame_t gfp, int buffer[])
+{
+    int const num_channels = global.split_channels;
+    unsigned int const tmp_num_samples = lame_get_num_samples(gfp);
+    int     samples_to_read = limit_samples_to_read(lame_get_framesize(gfp), tmp_num_samples);
+    int     samples_read;
+
+    assert(num_channels > 2);
+    if (global.snd_file) {
+#ifdef LIBSNDFILE
+        samples_read = sf_read_int(global.snd_file, buffer, num_channels * samples_to_read);
+#else
+        samples_read = 0;
+#endif
+    }
+    else {
+        samples_read = read_samples_pcm(global.music_in, buffer, num_channels * samples_to_read);
+    }
+    if (samples_read < 0) {
+        return samples_read;
+    }
+    samples_read /= num_channels;
+    if (tmp_num_samples != MAX_U_32_NUM)
+        global. num_samples_read += samples_read;
+    return samples_read;
+}
+
 /************************************************************************
   get_audio_common - central functionality of get_audio*
     in: gfp
@@ -738,7 +821,7 @@ get_audio_common(lame_t gfp, int buffer[2][1152], short buffer16[2][1152])
     int     samples_read;
     int     framesize;
     int     samples_to_read;
-    unsigned int remaining, tmp_num_samples;
+    unsigned int tmp_num_samples;
     int     i;
     int    *p;
 
@@ -749,7 +832,7 @@ get_audio_common(lame_t gfp, int buffer[2][1152], short buffer16[2][1152])
      * will get out of sync if we read more than framesize worth of data.
      */
 
-    samples_to_read = framesize = lame_get_framesize(gfp);
+    framesize = lame_get_framesize(gfp);
     assert(framesize <= 1152);
 
     /* get num_samples */
@@ -760,25 +843,7 @@ get_audio_common(lame_t gfp, int buffer[2][1152], short buffer16[2][1152])
         tmp_num_samples = lame_get_num_samples(gfp);
     }
 
-    /* if this flag has been set, then we are carefull to read
-     * exactly num_samples and no more.  This is useful for .wav and .aiff
-     * files which have id3 or other tags at the end.  Note that if you
-     * are using LIBSNDFILE, this is not necessary 
-     */
-    if (global.count_samples_carefully) {
-        if (global.num_samples_read < tmp_num_samples) {
-            remaining = tmp_num_samples - global.num_samples_read;
-        }
-        else {
-            remaining = 0;
-        }
-        if (remaining < (unsigned int) framesize && 0 != tmp_num_samples)
-            /* in case the input is a FIFO (at least it's reproducible with
-               a FIFO) tmp_num_samples may be 0 and therefore remaining
-               would be 0, but we need to read some samples, so don't
-               change samples_to_read to the wrong value in this case */
-            samples_to_read = remaining;
-    }
+    samples_to_read = limit_samples_to_read(framesize, tmp_num_samples);
 
     if (is_mpeg_file_format(global_reader.input_format)) {
         if (buffer != NULL)
@@ -1130,7 +1195,10 @@ open_snd_file(lame_t gfp, char const *inPath)
 
 
         (void) lame_set_num_samples(gfp, gs_wfInfo.frames);
-        if (-1 == lame_set_num_channels(gfp, gs_wfInfo.channels)) {
+        if (gs_wfInfo.channels > 2 && global_reader.split_channels) {
+            global. split_channels = gs_wfInfo.channels;
+        }
+        if (-1 == lame_set_num_channels(gfp, global.split_channels ? 2 : gs_wfInfo.channels)) {
             if (global_ui_config.silent < 10) {
                 error_printf("Unsupported number of channels: %ud\n", gs_wfInfo.channels);
             }
@@ -1162,110 +1230,103 @@ open_snd_file(lame_t gfp, char const *inPath)
 
 
 /************************************************************************
-unpack_read_samples - read and unpack signed low-to-high byte or unsigned
-                      single byte input. (used for read_samples function)
-                      Output integers are stored in the native byte order
-                      (little or big endian).  -jd
-  in: samples_to_read
-      bytes_per_sample
-      swap_order    - set for high-to-low byte order input stream
- i/o: pcm_in
- out: sample_buffer  (must be allocated up to samples_to_read upon call)
-returns: number of samples read
+ PCM unpack kernels - convert samples_read packed input samples, which
+                      fread() left at the start of sample_buffer, to ints
+                      in place.  Working from the end backwards, no
+                      sample is overwritten before it has been read.
+                      There is one kernel per sample width and byte
+                      order; select_unpack_pcm() picks it when the
+                      input file is opened.
 */
+#define UNPACK_PCM_KERNEL(name, bytes, expr) \
+static void \
+name(int *sample_buffer, int samples_read) \
+{ \
+    unsigned char const *ip = (unsigned char const *) sample_buffer; \
+    int     i; \
+    for (i = samples_read; --i >= 0;) { \
+        unsigned char const *const p = ip + i * bytes; \
+        sample_buffer[i] = (int) (expr); \
+    } \
+}
+
+#define UPCM_SHL(x, n) ((unsigned int) (x) << (8 * sizeof(int) - (n)))
+
+/* signed, low-to-high byte order; signed 8 bit */
+UNPACK_PCM_KERNEL(unpack_pcm_8, 1, UPCM_SHL(p[0], 8))
+UNPACK_PCM_KERNEL(unpack_pcm_16, 2, UPCM_SHL(p[0], 16) | UPCM_SHL(p[1], 8))
+UNPACK_PCM_KERNEL(unpack_pcm_24, 3, UPCM_SHL(p[0], 24) | UPCM_SHL(p[1], 16) | UPCM_SHL(p[2], 8))
+UNPACK_PCM_KERNEL(unpack_pcm_32, 4,
+                  UPCM_SHL(p[0], 32) | UPCM_SHL(p[1], 24) | UPCM_SHL(p[2], 16) | UPCM_SHL(p[3], 8))
+/* signed, high-to-low byte order; unsigned 8 bit */
+UNPACK_PCM_KERNEL(unpack_pcm_8u, 1, UPCM_SHL(p[0] ^ 0x80, 8) | UPCM_SHL(0x7f, 16))
+UNPACK_PCM_KERNEL(unpack_pcm_16s, 2, UPCM_SHL(p[0], 8) | UPCM_SHL(p[1], 16))
+UNPACK_PCM_KERNEL(unpack_pcm_24s, 3, UPCM_SHL(p[0], 8) | UPCM_SHL(p[1], 16) | UPCM_SHL(p[2], 24))
+UNPACK_PCM_KERNEL(unpack_pcm_32s, 4,
+                  UPCM_SHL(p[0], 8) | UPCM_SHL(p[1], 16) | UPCM_SHL(p[2], 24) | UPCM_SHL(p[3], 32))
+
+#undef UPCM_SHL
+#undef UNPACK_PCM_KERNEL
+
 static int
-unpack_read_samples(const int samples_to_read, const int bytes_per_sample,
-                    const int swap_order, int *sample_buffer, FILE * pcm_in)
+ieee_float_to_int(ieee754_float32_t u)
 {
-    int     samples_read;
-    int     i;
-    int    *op;              /* output pointer */
-    unsigned char *ip = (unsigned char *) sample_buffer; /* input pointer */
-    const int b = sizeof(int) * 8;
-
-    {
-        size_t  samples_read_ = fread(sample_buffer, bytes_per_sample, samples_to_read, pcm_in);
-        assert( samples_read_ <= INT_MAX );
-        samples_read = (int) samples_read_;
-    }
-    op = sample_buffer + samples_read;
-
-#define GA_URS_IFLOOP( ga_urs_bps ) \
-    if( bytes_per_sample == ga_urs_bps ) \
-      for( i = samples_read * bytes_per_sample; (i -= bytes_per_sample) >=0;)
-
-    if (swap_order == 0) {
-        GA_URS_IFLOOP(1)
-            * --op = ip[i] << (b - 8);
-        GA_URS_IFLOOP(2)
-            * --op = ip[i] << (b - 16) | ip[i + 1] << (b - 8);
-        GA_URS_IFLOOP(3)
-            * --op = ip[i] << (b - 24) | ip[i + 1] << (b - 16) | ip[i + 2] << (b - 8);
-        GA_URS_IFLOOP(4)
-            * --op =
-            ip[i] << (b - 32) | ip[i + 1] << (b - 24) | ip[i + 2] << (b - 16) | ip[i + 3] << (b -
-                                                                                              8);
+    ieee754_float32_t const m_max = INT_MAX;
+    ieee754_float32_t const m_min = -(ieee754_float32_t) INT_MIN;
+    if (u >= 1) {
+        return INT_MAX;
     }
-    else {
-        GA_URS_IFLOOP(1)
-            * --op = (ip[i] ^ 0x80) << (b - 8) | 0x7f << (b - 16); /* convert from unsigned */
-        GA_URS_IFLOOP(2)
-            * --op = ip[i] << (b - 8) | ip[i + 1] << (b - 16);
-        GA_URS_IFLOOP(3)
-            * --op = ip[i] << (b - 8) | ip[i + 1] << (b - 16) | ip[i + 2] << (b - 24);
-        GA_URS_IFLOOP(4)
-            * --op =
-            ip[i] << (b - 8) | ip[i + 1] << (b - 16) | ip[i + 2] << (b - 24) | ip[i + 3] << (b -
-                                                                                             32);
-    }
-#undef GA_URS_IFLOOP
-    if (global.pcm_is_ieee_float) {
-        ieee754_float32_t const m_max = INT_MAX;
-        ieee754_float32_t const m_min = -(ieee754_float32_t) INT_MIN;
-        ieee754_float32_t *x = (ieee754_float32_t *) sample_buffer;
-        assert(sizeof(ieee754_float32_t) == sizeof(int));
-        for (i = 0; i < samples_to_read; ++i) {
-            ieee754_float32_t const u = x[i];
-            int     v;
-            if (u >= 1) {
-                v = INT_MAX;
-            }
-            else if (u <= -1) {
-                v = INT_MIN;
-            }
-            else if (u >= 0) {
-                v = (int) (u * m_max + 0.5f);
-            }
-            else {
-                v = (int) (u * m_min - 0.5f);
-            }
-            sample_buffer[i] = v;
-        }
+    else if (u <= -1) {
+        return INT_MIN;
+    }
+    else if (u >= 0) {
+        return (int) (u * m_max + 0.5f);
     }
-    return (samples_read);
+    return (int) (u * m_min - 0.5f);
 }
 
+/* 32 bit IEEE float, either byte order */
+static void
+unpack_pcm_float(int *sample_buffer, int samples_read)
+{
+    ieee754_float32_t *x = (ieee754_float32_t *) sample_buffer;
+    int     i;
+    assert(sizeof(ieee754_float32_t) == sizeof(int));
+    unpack_pcm_32(sample_buffer, samples_read);
+    for (i = 0; i < samples_read; ++i) {
+        sample_buffer[i] = ieee_float_to_int(x[i]);
+    }
+}
+
+static void
+unpack_pcm_float_s(int *sample_buffer, int samples_read)
+{
+    ieee754_float32_t *x = (ieee754_float32_t *) sample_buffer;
+    int     i;
+    assert(sizeof(ieee754_float32_t) == sizeof(int));
+    unpack_pcm_32s(sample_buffer, samples_read);
+    for (i = 0; i < samples_read; ++i) {
+        sample_buffer[i] = ieee_float_to_int(x[i]);
+    }
+}
 
 
 /************************************************************************
-*
-* read_samples()
-*
-* PURPOSE:  reads the PCM samples from a file to the buffer
-*
-*  SEMANTICS:
-* Reads #samples_read# number of shorts from #musicin# filepointer
-* into #sample_buffer[]#.  Returns the number of samples read.
-*
-************************************************************************/
-
+ select_unpack_pcm - choose the unpack kernel for the PCM input format.
+                     Called once the input file header has been parsed.
+returns: 0 on success, -1 for an unsupported format
+*/
 static int
-read_samples_pcm(FILE * musicin, int sample_buffer[2304], int samples_to_read)
+select_unpack_pcm(void)
 {
-    int     samples_read;
-    int     bytes_per_sample = global.pcmbitwidth / 8;
+    static void (*const kernel[2][4]) (int *, int) = {
+        {unpack_pcm_8, unpack_pcm_16, unpack_pcm_24, unpack_pcm_32},
+        {unpack_pcm_8u, unpack_pcm_16s, unpack_pcm_24s, unpack_pcm_32s}
+    };
     int     swap_byte_order; /* byte order of input stream */
 
+    global. unpack_pcm = NULL;
+    global. pcm_bytes_per_sample = global.pcmbitwidth / 8;
     switch (global.pcmbitwidth) {
     case 32:
     case 24:
@@ -1292,8 +1353,40 @@ read_samples_pcm(FILE * musicin, int sample_buffer[2304], int samples_to_read)
         }
         return -1;
     }
-    samples_read = unpack_read_samples(samples_to_read, bytes_per_sample, swap_byte_order,
-                                       sample_buffer, musicin);
+    if (global.pcm_is_ieee_float && global.pcmbitwidth == 32) {
+        global. unpack_pcm = swap_byte_order ? unpack_pcm_float_s : unpack_pcm_float;
+    }
+    else {
+        global. unpack_pcm = kernel[swap_byte_order][global.pcm_bytes_per_sample - 1];
+    }
+    return 0;
+}
+
+
+
+/************************************************************************
+*
+* read_samples()
+*
+* PURPOSE:  reads the PCM samples from a file to the buffer
+*
+*  SEMANTICS:
+* Reads #samples_read# number of shorts from #musicin# filepointer
+* into #sample_buffer[]#.  Returns the number of samples read.
+*
+************************************************************************/
+
+static int
+read_samples_pcm(FILE * musicin, int sample_buffer[2304], int samples_to_read)
+{
+    size_t  samples_read;
+
+    if (global.unpack_pcm == NULL) {
+        return -1;      /* unsupported format, see select_unpack_pcm() */
+    }
+    samples_read = fread(sample_buffer, global.pcm_bytes_per_sample, samples_to_read, musicin);
+    assert( samples_read <= INT_MAX );
+    global.unpack_pcm(sample_buffer, (int) samples_read);
     if (ferror(musicin)) {
         if (global_ui_config.silent < 10) {
             error_printf("Error reading input file\n");
@@ -1301,7 +1394,7 @@ read_samples_pcm(FILE * musicin, int sample_buffer[2304], int samples_to_read)
         return -1;
     }
 
-    return samples_read;
+    return (int) samples_read;
 }
 
 
@@ -1445,7 +1538,10 @@ parse_wave_header(lame_global_flags * gfp, FILE * sf)
 
 
         /* make sure the header is sane */
-        if (-1 == lame_set_num_channels(gfp, channels)) {
+        if (channels > 2 && global_reader.split_channels) {
+            global. split_channels = channels;
+        }
+        if (-1 == lame_set_num_channels(gfp, global.split_channels ? 2 : channels)) {
             if (global_ui_config.silent < 10) {
                 error_printf("Unsupported number of channels: %u\n", channels);
             }
@@ -50,6 +50,8 @@ int     samples_to_skip_at_end(void);
 void    close_infile(void);
 int     get_audio(lame_t gfp, int buffer[2][1152]);
 int     get_audio16(lame_t gfp, short buffer[2][1152]);
+int     get_split_channels(void);
+int     get_audio_split(lame_t gfp, int buffer[]);
 int     get_audio_float(lame_t gfp, float buffer[2][1152]);
 int     get_audio_double(lame_t gfp, double buffer[2][1152]);
 hip_t   get_hip(void);
@@ -81,6 +81,11 @@ char   *strchr(), *strrchr();
 #include <dmalloc.h>
 #endif
 
+/* encoder output of one frame of input, or of the final flush.  The
+ * ID3v2 tag is written by write_id3v2_tag(), not by the encoder, so no
+ * room for album art is needed as with LAME_MAXMP3BUFFER. */
+#define MP3BUFFER_SIZE 16384
+
 
 
 
@@ -94,10 +99,33 @@ char   *strchr(), *strrchr();
 ************************************************************************/
 
 
+/* output file of channel pair k for --split-channels:
+ * "out.mp3" becomes "out.1.mp3", "out.2.mp3", ... */
+static int
+split_stream_path(char *splitPath, char const *outPath, int k)
+{
+    char const *ext = strrchr(outPath, '.');
+    size_t  n;
+
+    if (ext == NULL || strchr(ext, '/') != NULL || strchr(ext, '\\') != NULL) {
+        ext = outPath + strlen(outPath);
+    }
+    n = ext - outPath;
+    if (n + strlen(ext) + 12 > PATH_MAX) {
+        error_printf("Output file name too long: '%s'\n", outPath);
+        return -1;
+    }
+    memcpy(splitPath, outPath, n);
+    sprintf(splitPath + n, ".%d%s", k + 1, ext);
+    return 0;
+}
+
+
 static FILE *
 init_files(lame_global_flags * gf, char const *inPath, char const *outPath)
 {
     FILE   *outf;
+    char    splitPath[PATH_MAX + 1];
     /* Mostly it is not useful to use the same input and output name.
        This test is very easy and buggy and don't recognize different names
        assigning the same file
@@ -117,6 +145,17 @@ init_files(lame_global_flags * gf, char const *inPath, char const *outPath)
         error_printf("Can't init infile '%s'\n", inPath);
         return NULL;
     }
+    if (get_split_channels() > 0) {
+        /* this is the file of the first channel pair, see lame_split_encoder */
+        if (0 == strcmp("-", outPath)) {
+            error_printf("--split-channels can't write to <stdout>\n");
+            return NULL;
+        }
+        if (split_stream_path(splitPath, outPath, 0) < 0) {
+            return NULL;
+        }
+        outPath = splitPath;
+    }
     if ((outf = init_outfile(outPath, lame_get_decode_only(gf))) == NULL) {
         error_printf("Can't init outfile '%s'\n", outPath);
         return NULL;
@@ -313,13 +352,22 @@ print_trailing_info(lame_global_flags * gf)
         }
     }
 
+    if (global_ui_config.silent <= -10) {
+        int     recovery[5] = { 0, 0, 0, 0, 0 };
+        lame_vbr_recovery_hist(gf, recovery);
+        if (recovery[0] > 0) {
+            console_printf("VBR granules over budget: %d (flattened %d, raised %d, global gain %d),"
+                           " %.1f trial quantizations each\n", recovery[0], recovery[1],
+                           recovery[2], recovery[3], (double) recovery[4] / recovery[0]);
+        }
+    }
 }
 
 
 static int
 write_xing_frame(lame_global_flags * gf, FILE * outf, size_t offset)
 {
-    unsigned char mp3buffer[LAME_MAXMP3BUFFER];
+    unsigned char mp3buffer[MP3BUFFER_SIZE];
     size_t  imp3, owrite;
 
     imp3 = lame_get_lametag_frame(gf, mp3buffer, sizeof(mp3buffer));
@@ -378,24 +426,16 @@ write_id3v1_tag(lame_t gf, FILE * outf)
 
 
 static int
-lame_encoder_loop(lame_global_flags * gf, FILE * outf, int nogap, char *inPath, char *outPath)
+write_id3v2_tag(lame_t gf, FILE * outf, size_t * id3v2_size)
 {
-    unsigned char mp3buffer[LAME_MAXMP3BUFFER];
-    int     Buffer[2][1152];
-    int     iread, imp3, owrite;
-    size_t  id3v2_size;
-
-    encoder_progress_begin(gf, inPath, outPath);
-
-    id3v2_size = lame_get_id3v2_tag(gf, 0, 0);
-    if (id3v2_size > 0) {
-        unsigned char *id3v2tag = malloc(id3v2_size);
+    *id3v2_size = lame_get_id3v2_tag(gf, 0, 0);
+    if (*id3v2_size > 0) {
+        unsigned char *id3v2tag = malloc(*id3v2_size);
         if (id3v2tag != 0) {
-            size_t  n_bytes = lame_get_id3v2_tag(gf, id3v2tag, id3v2_size);
+            size_t  n_bytes = lame_get_id3v2_tag(gf, id3v2tag, *id3v2_size);
             size_t  written = fwrite(id3v2tag, 1, n_bytes, outf);
             free(id3v2tag);
             if (written != n_bytes) {
-                encoder_progress_end(gf);
                 error_printf("Error writing ID3v2 tag \n");
                 return 1;
             }
@@ -403,11 +443,10 @@ lame_encoder_loop(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
     }
     else {
         unsigned char* id3v2tag = getOldTag(gf);
-        id3v2_size = sizeOfOldTag(gf);
-        if ( id3v2_size > 0 ) {
-            size_t owrite = fwrite(id3v2tag, 1, id3v2_size, outf);
-            if (owrite != id3v2_size) {
-                encoder_progress_end(gf);
+        *id3v2_size = sizeOfOldTag(gf);
+        if ( *id3v2_size > 0 ) {
+            size_t owrite = fwrite(id3v2tag, 1, *id3v2_size, outf);
+            if (owrite != *id3v2_size) {
                 error_printf("Error writing ID3v2 tag \n");
                 return 1;
             }
@@ -416,6 +455,69 @@ lame_encoder_loop(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
     if (global_writer.flush_write == 1) {
         fflush(outf);
     }
+    return 0;
+}
+
+
+static int
+write_mp3_buffer(FILE * outf, unsigned char const *mp3buffer, int imp3)
+{
+    int     owrite;
+
+    /* was our output buffer big enough? */
+    if (imp3 < 0) {
+        if (imp3 == -1)
+            error_printf("mp3 buffer is not big enough... \n");
+        else
+            error_printf("mp3 internal error:  error code=%i\n", imp3);
+        return 1;
+    }
+    owrite = (int) fwrite(mp3buffer, 1, imp3, outf);
+    if (owrite != imp3) {
+        error_printf("Error writing mp3 output \n");
+        return 1;
+    }
+    return 0;
+}
+
+
+static int
+write_trailing_tags(lame_t gf, FILE * outf, size_t id3v2_size)
+{
+    int     ret;
+
+    if (global_writer.flush_write == 1) {
+        fflush(outf);
+    }
+    ret = write_id3v1_tag(gf, outf);
+    if (global_writer.flush_write == 1) {
+        fflush(outf);
+    }
+    if (ret) {
+        return 1;
+    }
+    write_xing_frame(gf, outf, id3v2_size);
+    if (global_writer.flush_write == 1) {
+        fflush(outf);
+    }
+    return 0;
+}
+
+
+static int
+lame_encoder_loop(lame_global_flags * gf, FILE * outf, int nogap, char *inPath, char *outPath)
+{
+    unsigned char mp3buffer[MP3BUFFER_SIZE];
+    int     Buffer[2][1152];
+    int     iread, imp3;
+    size_t  id3v2_size;
+
+    encoder_progress_begin(gf, inPath, outPath);
+
+    if (write_id3v2_tag(gf, outf, &id3v2_size)) {
+        encoder_progress_end(gf);
+        return 1;
+    }
 
     /* encode until we hit eof */
     do {
@@ -429,17 +531,7 @@ lame_encoder_loop(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
             imp3 = lame_encode_buffer_int(gf, Buffer[0], Buffer[1], iread,
                                           mp3buffer, sizeof(mp3buffer));
 
-            /* was our output buffer big enough? */
-            if (imp3 < 0) {
-                if (imp3 == -1)
-                    error_printf("mp3 buffer is not big enough... \n");
-                else
-                    error_printf("mp3 internal error:  error code=%i\n", imp3);
-                return 1;
-            }
-            owrite = (int) fwrite(mp3buffer, 1, imp3, outf);
-            if (owrite != imp3) {
-                error_printf("Error writing mp3 output \n");
+            if (write_mp3_buffer(outf, mp3buffer, imp3)) {
                 return 1;
             }
         }
@@ -454,35 +546,17 @@ lame_encoder_loop(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
         imp3 = lame_encode_flush(gf, mp3buffer, sizeof(mp3buffer)); /* may return one more mp3 frame */
 
     if (imp3 < 0) {
-        if (imp3 == -1)
-            error_printf("mp3 buffer is not big enough... \n");
-        else
-            error_printf("mp3 internal error:  error code=%i\n", imp3);
-        return 1;
-
+        return write_mp3_buffer(outf, mp3buffer, imp3);
     }
 
     encoder_progress_end(gf);
 
-    owrite = (int) fwrite(mp3buffer, 1, imp3, outf);
-    if (owrite != imp3) {
-        error_printf("Error writing mp3 output \n");
+    if (write_mp3_buffer(outf, mp3buffer, imp3)) {
         return 1;
     }
-    if (global_writer.flush_write == 1) {
-        fflush(outf);
-    }
-    imp3 = write_id3v1_tag(gf, outf);
-    if (global_writer.flush_write == 1) {
-        fflush(outf);
-    }
-    if (imp3) {
+    if (write_trailing_tags(gf, outf, id3v2_size)) {
         return 1;
     }
-    write_xing_frame(gf, outf, id3v2_size);
-    if (global_writer.flush_write == 1) {
-        fflush(outf);
-    }
     if (global_ui_config.silent <= 0) {
         print_trailing_info(gf);
     }
@@ -502,6 +576,148 @@ lame_encoder(lame_global_flags * gf, FILE * outf, int nogap, char *inPath, char
 }
 
 
+/* One encoder per channel pair of a --split-channels input, the last one
+ * mono for an odd number of channels.  The input is read and converted
+ * once; every encoder takes its pair straight out of the interleaved
+ * buffer.  All encoders are set up from the same command line and see
+ * the same number of samples, so encoder delay and padding (and thereby
+ * the LAME tags) of all streams agree and the decoded streams line up
+ * sample for sample.
+ */
+typedef struct {
+    lame_t  gf;
+    FILE   *outf;
+    size_t  id3v2_size;
+    char    outPath[PATH_MAX + 1];
+} split_stream;
+
+static int
+lame_split_encoder(lame_t gf, FILE * outf, int argc, char **argv, char *inPath, char *outPath)
+{
+    unsigned char mp3buffer[MP3BUFFER_SIZE];
+    int const channels = get_split_channels();
+    int const streams = (channels + 1) / 2;
+    split_stream *stream = calloc(streams, sizeof(split_stream));
+    int    *Buffer = malloc(channels * 1152 * sizeof(int));
+    int     iread, imp3, k, ret = 1;
+
+    if (stream != NULL) {
+        /* from here on the cleanup below closes outf */
+        stream[0].gf = gf;
+        stream[0].outf = outf;
+    }
+    if (stream == NULL || Buffer == NULL) {
+        error_printf("Not enough memory for %d channels\n", channels);
+        goto done;
+    }
+    split_stream_path(stream[0].outPath, outPath, 0);
+    for (k = 1; k < streams; ++k) {
+        split_stream *const st = &stream[k];
+        char    argPath[2][PATH_MAX + 1];
+
+        if (split_stream_path(st->outPath, outPath, k) < 0) {
+            goto done;
+        }
+        st->gf = lame_init();
+        if (st->gf == NULL) {
+            error_printf("fatal error during initialization\n");
+            goto done;
+        }
+        lame_set_msgf(st->gf, &frontend_msgf);
+        lame_set_errorf(st->gf, &frontend_errorf);
+        lame_set_debugf(st->gf, &frontend_debugf);
+        if (parse_args(st->gf, argc, argv, argPath[0], argPath[1], NULL, NULL) < 0) {
+            goto done;
+        }
+        (void) lame_set_num_channels(st->gf, channels - 2 * k > 1 ? 2 : 1);
+        (void) lame_set_in_samplerate(st->gf, lame_get_in_samplerate(gf));
+        (void) lame_set_num_samples(st->gf, lame_get_num_samples(gf));
+        lame_set_write_id3tag_automatic(st->gf, 0);
+        if (lame_init_params(st->gf) < 0) {
+            error_printf("fatal error during initialization\n");
+            goto done;
+        }
+        if ((st->outf = init_outfile(st->outPath, 0)) == NULL) {
+            error_printf("Can't init outfile '%s'\n", st->outPath);
+            goto done;
+        }
+    }
+    /* parse_args() above reset the display options */
+    if (global_ui_config.silent > 0) {
+        global_ui_config.brhist = 0;
+    }
+
+    encoder_progress_begin(gf, inPath, stream[0].outPath);
+
+    for (k = 0; k < streams; ++k) {
+        if (write_id3v2_tag(stream[k].gf, stream[k].outf, &stream[k].id3v2_size)) {
+            encoder_progress_end(gf);
+            goto done;
+        }
+    }
+
+    /* encode until we hit eof */
+    do {
+        iread = get_audio_split(gf, Buffer);
+        if (iread >= 0) {
+            encoder_progress(gf);
+            for (k = 0; k < streams; ++k) {
+                imp3 = lame_encode_buffer_strided_int(stream[k].gf, Buffer + 2 * k, channels,
+                                                      iread, mp3buffer, sizeof(mp3buffer));
+                if (write_mp3_buffer(stream[k].outf, mp3buffer, imp3)) {
+                    goto done;
+                }
+                if (global_writer.flush_write == 1) {
+                    fflush(stream[k].outf);
+                }
+            }
+        }
+    } while (iread > 0);
+
+    for (k = 0; k < streams; ++k) {
+        imp3 = lame_encode_flush(stream[k].gf, mp3buffer, sizeof(mp3buffer));
+        if (write_mp3_buffer(stream[k].outf, mp3buffer, imp3)) {
+            goto done;
+        }
+    }
+
+    encoder_progress_end(gf);
+
+    for (k = 0; k < streams; ++k) {
+        if (global_ui_config.silent <= 0) {
+            if (2 * k + 1 < channels)
+                console_printf("%s: channels %d+%d\n", stream[k].outPath, 2 * k + 1, 2 * k + 2);
+            else
+                console_printf("%s: channel %d\n", stream[k].outPath, 2 * k + 1);
+        }
+        if (write_trailing_tags(stream[k].gf, stream[k].outf, stream[k].id3v2_size)) {
+            goto done;
+        }
+        if (global_ui_config.silent <= 0) {
+            print_trailing_info(stream[k].gf);
+        }
+    }
+    ret = 0;
+
+  done:
+    if (stream != NULL) {
+        for (k = 0; k < streams; ++k) {
+            if (stream[k].outf != NULL)
+                fclose(stream[k].outf);
+            if (k > 0 && stream[k].gf != NULL)
+                lame_close(stream[k].gf);
+        }
+        free(stream);
+    }
+    else {
+        fclose(outf);
+    }
+    free(Buffer);
+    close_infile();
+    return ret;
+}
+
+
 static void
 parse_nogap_filenames(int nogapout, char const *inPath, char *outPath, char *outdir)
 {
@@ -638,6 +854,10 @@ lame_main(lame_t gf, int argc, char **argv)
     if (outf == NULL) {
         return -1;
     }
+    if (get_split_channels() > 0 && max_nogap > 0) {
+        error_printf("--split-channels can't be used with --nogap\n");
+        return -1;
+    }
     /* turn off automatic writing of ID3 tag data into mp3 stream 
      * we have to call it before 'lame_init_params', because that
      * function would spit out ID3v2 tag data.
@@ -664,6 +884,10 @@ lame_main(lame_t gf, int argc, char **argv)
         /* decode an mp3 file to a .wav */
         ret = lame_decoder(gf, outf, inPath, outPath);
     }
+    else if (get_split_channels() > 0) {
+        /* encode each channel pair to a file of its own */
+        ret = lame_split_encoder(gf, outf, argc, argv, inPath, outPath);
+    }
     else if (max_nogap == 0) {
         /* encode a single input file */
         ret = lame_encoder(gf, outf, 0, inPath, outPath);
@@ -47,6 +47,7 @@ typedef struct ReaderConfig
     sound_file_format input_format;
     int   swapbytes;                /* force byte swapping   default=0 */
     int   swap_channel;             /* 0: no-op, 1: swaps input channels */
+    int   split_channels;           /* 1: encode >2 input channels in pairs */
     int   input_samplerate;
 } ReaderConfig;
 
@@ -61,6 +62,7 @@ typedef struct UiConfig
     int   brhist;
     int   print_clipping_info;      /* print info whether waveform clips */
     float update_interval;          /* to use Frank's time status display */
+    int   progress_fd;              /* JSON lines progress report, -1: none */
 } UiConfig;
 
 typedef struct DecoderConfig
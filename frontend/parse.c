@@ -99,10 +99,10 @@ static int const internal_opts_enabled = INTERNAL_OPTS;
 /* GLOBAL VARIABLES.  set by parse_args() */
 /* we need to clean this up */
 
-ReaderConfig global_reader = { sf_unknown, 0, 0, 0 };
+ReaderConfig global_reader = { sf_unknown, 0, 0, 0, 0 };
 WriterConfig global_writer = { 0 };
 
-UiConfig global_ui_config = {0,0,0,0};
+UiConfig global_ui_config = {0,0,0,0,-1};
 
 DecoderConfig global_decoder;
 
@@ -731,12 +731,15 @@ long_help(const lame_global_flags * gfp, FILE * const fp, const char *ProgramNam
             "    --freeformat    produce a free format bitstream\n"
             "    --decode        input=mp3 file, output=wav\n"
             "    --swap-channel  swap L/R channels\n"
+            "    --split-channels  encode WAV input with more than two channels as\n"
+            "                    channel pairs into <outfile>.1.mp3, <outfile>.2.mp3, ...\n"
             "    -t              disable writing wav header when using --decode\n");
 
     wait_for(fp, lessmode);
     fprintf(fp,
             "  Verbosity:\n"
             "    --disptime <arg>print progress report every arg seconds\n"
+            "    --progress-fd <n>  write progress as JSON lines to file descriptor n\n"
             "    -S              don't print progress report, VBR histograms\n"
             "    --nohist        disable VBR histogram display\n"
             "    --quiet         don't print anything on screen\n"
@@ -1998,6 +2001,11 @@ parse_args_(lame_global_flags * gfp, int argc, char **argv,
                     if (argUsed)
                         global_ui_config.update_interval = (float) double_value;
 
+                T_ELIF("progress-fd")
+                    argUsed = getIntValue(token, nextArg, &int_value);
+                    if (argUsed)
+                        global_ui_config.progress_fd = int_value;
+
                 T_ELIF("nogaptags")
                     nogap_tags = 1;
 
@@ -2017,6 +2025,9 @@ parse_args_(lame_global_flags * gfp, int argc, char **argv,
                 T_ELIF("swap-channel")
                     global_reader.swap_channel = 1;
 
+                T_ELIF("split-channels")
+                    global_reader.split_channels = 1;
+
                 T_ELIF ("athaa-sensitivity")
                     argUsed = getDoubleValue(token, nextArg, &double_value);
                     if (argUsed)
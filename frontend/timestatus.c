@@ -39,6 +39,14 @@
 #include <time.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+# include <io.h>
+#else
+# include <unistd.h>
+# include <poll.h>
+#endif
 
 #include "lame.h"
 #include "main.h"
@@ -64,6 +72,9 @@ static struct EncoderProgress {
     double  last_time;
     int     last_frame_num;
     int     time_status_init;
+    double  fd_real_start;   /* --progress-fd */
+    double  fd_proc_start;
+    unsigned long fd_dropped;
 } global_encoder_progress;
 
 
@@ -190,6 +201,67 @@ timestatus_finish(void)
 }
 
 
+/*
+ * --progress-fd: one JSON object per line, for programs driving lame.
+ * A line the reader has no room for is dropped (and counted) rather than
+ * stalling the encoder: poll() tells whether a write would block.  The
+ * descriptor itself is left in blocking mode, its file status flags are
+ * shared with every other process holding it.  The last line, with
+ * "state":"done", is always written, so it always gets through.
+ */
+static void
+progress_fd_begin(void)
+{
+    global_encoder_progress.fd_real_start = GetRealTime();
+    global_encoder_progress.fd_proc_start = GetCPUTime();
+    global_encoder_progress.fd_dropped = 0;
+}
+
+/* nonzero if a line (less than PIPE_BUF bytes) can be written without blocking */
+static int
+progress_fd_writable(void)
+{
+#if defined(_WIN32) && !defined(__CYGWIN__)
+    /* no poll() on pipes; a stalled reader blocks the encoder, as documented */
+    return 1;
+#else
+    struct pollfd pfd;
+    pfd.fd = global_ui_config.progress_fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLOUT) != 0;
+#endif
+}
+
+static void
+progress_fd_report(lame_global_flags const* gf, int done)
+{
+    char    line[256];
+    int     n;
+    int const frameNum = lame_get_frameNum(gf);
+    int const totalframes = lame_get_totalframes(gf) < frameNum ? frameNum : lame_get_totalframes(gf);
+    double const audio = (double) frameNum * lame_get_framesize(gf) / lame_get_out_samplerate(gf);
+    double const real = GetRealTime() - global_encoder_progress.fd_real_start;
+    double const proc = GetCPUTime() - global_encoder_progress.fd_proc_start;
+    double const eta = frameNum > 0 ? real * (totalframes - frameNum) / frameNum : 0;
+
+    if (!done && !progress_fd_writable()) {
+        global_encoder_progress.fd_dropped++;
+        return;
+    }
+    n = sprintf(line, "{\"state\":\"%s\",\"frame\":%d,\"frames\":%d,\"percent\":%.1f,"
+                "\"audio\":%.3f,\"real\":%.3f,\"cpu\":%.3f,\"speed\":%.2f,\"eta\":%.1f,"
+                "\"dropped\":%lu}\n",
+                done ? "done" : "encoding", frameNum, totalframes,
+                totalframes > 0 ? 100. * frameNum / totalframes : 0.,
+                audio, real, proc, real > 0 ? audio / real : 0., eta,
+                global_encoder_progress.fd_dropped);
+    if (write(global_ui_config.progress_fd, line, n) != n) {
+        global_encoder_progress.fd_dropped++;
+    }
+}
+
+
 static void
 brhist_init_package(lame_global_flags const* gf)
 {
@@ -215,6 +287,9 @@ encoder_progress_begin( lame_global_flags const* gf
     global_encoder_progress.time_status_init = 0;
     global_encoder_progress.last_time = 0;
     global_encoder_progress.last_frame_num = 0;
+    if (global_ui_config.progress_fd >= 0) {
+        progress_fd_begin();
+    }
     if (global_ui_config.silent < 9) {
         char* i_file = 0;
         char* o_file = 0;
@@ -286,7 +361,7 @@ encoder_progress_begin( lame_global_flags const* gf
 void
 encoder_progress( lame_global_flags const* gf )
 {
-    if (global_ui_config.silent <= 0) {
+    if (global_ui_config.silent <= 0 || global_ui_config.progress_fd >= 0) {
         int const frames = lame_get_frameNum(gf);
         int const frames_diff = frames - global_encoder_progress.last_frame_num;
         if (global_ui_config.update_interval <= 0) {     /*  most likely --disptime x not used */
@@ -305,6 +380,12 @@ encoder_progress( lame_global_flags const* gf )
             }
             global_encoder_progress.last_time = GetRealTime(); /* from now! disp_time seconds */
         }
+        if (global_ui_config.progress_fd >= 0) {
+            progress_fd_report(gf, 0);
+        }
+        if (global_ui_config.silent > 0) {
+            return;
+        }
         if (global_ui_config.brhist) {
             brhist_jump_back();
         }
@@ -319,6 +400,9 @@ encoder_progress( lame_global_flags const* gf )
 void
 encoder_progress_end( lame_global_flags const* gf )
 {
+    if (global_ui_config.progress_fd >= 0) {
+        progress_fd_report(gf, 1);
+    }
     if (global_ui_config.silent <= 0) {
         if (global_ui_config.brhist) {
             brhist_jump_back();
@@ -303,6 +303,14 @@ int CDECL lame_get_findReplayGain(const lame_global_flags *);
 int CDECL lame_set_decode_on_the_fly(lame_global_flags *, int);
 int CDECL lame_get_decode_on_the_fly(const lame_global_flags *);
 
+/* switch the FPU to flush-to-zero / denormals-are-zero while the
+ * lame_encode_* functions run, and restore the caller's mode on return.
+ * Avoids the denormal slowdown on fades to silence. Only has an effect
+ * where LAME does its float math in SSE (x86-64). The PCM source and the
+ * report functions are called in the caller's own mode. default = 1 (enabled) */
+int CDECL lame_set_flush_denormals(lame_global_flags *, int);
+int CDECL lame_get_flush_denormals(const lame_global_flags *);
+
 #if DEPRECATED_OR_OBSOLETE_CODE_REMOVED
 #else
 /* DEPRECATED: now does the same as lame_set_findReplayGain()
@@ -593,7 +601,7 @@ int CDECL lame_get_mf_samples_to_encode( const lame_global_flags*  gfp );
 */
 int CDECL lame_get_size_mp3buffer( const lame_global_flags*  gfp );
 
-/* number of frames encoded so far */
+/* number of frames encoded so far, may be called from another thread while encoding */
 int CDECL lame_get_frameNum(const lame_global_flags *);
 
 /*
@@ -837,6 +845,66 @@ int CDECL lame_encode_buffer_int(
         const int           mp3buf_size ); /* number of valid octets in this
                                               stream                        */
 
+/* as lame_encode_buffer_int, but takes one channel or channel pair out of
+ * interleaved input with any number of channels: sample i is pcm[i*stride]
+ * and, for a stereo session, pcm[i*stride+1].  Several sessions can thus
+ * encode the channel pairs of one multichannel buffer in place.
+ * stride must be at least the number of channels of the session.
+ */
+int CDECL lame_encode_buffer_strided_int(
+        lame_t              gfp,
+        const int           pcm[],         /* first channel of the pair     */
+        int                 stride,        /* ints from sample to sample    */
+        const int           nsamples,      /* number of samples per channel */
+        unsigned char*      mp3buf,        /* pointer to encoded MP3 stream */
+        const int           mp3buf_size ); /* number of valid octets in this
+                                              stream                        */
+
+
+/*
+ * OPTIONAL:
+ * pull model input.  Instead of pushing PCM with lame_encode_buffer*(),
+ * the application registers a source function and calls lame_encode_run().
+ * The encoder asks the source for the samples it needs and lets it write
+ * them directly into encoder owned memory, which saves the copies of the
+ * push interface whenever no resampling, scaling or downmix is required.
+ *
+ * The source writes up to 'nsamples' samples per channel, scaled like the
+ * input of lame_encode_buffer_float() (+/- 32768 for full scale), to
+ * pcm_l and, for stereo input, pcm_r (NULL for mono input).  It returns
+ * the number of samples written, 0 at end of stream, negative on error.
+ * It runs in the floating point mode of the lame_encode_run() caller,
+ * see lame_set_flush_denormals().
+ */
+typedef int (*lame_pcm_source_function)(void *data, float *pcm_l, float *pcm_r,
+                                        int nsamples);
+
+int CDECL lame_set_pcm_source(
+        lame_global_flags*       gfp,
+        lame_pcm_source_function func,  /* NULL to unregister            */
+        void*                    data ); /* passed to func               */
+
+/*
+ * encode from the registered PCM source until it reports end of stream
+ * or mp3buf has no room left for the worst case of another frame.
+ * Call it again until it returns 0, then call lame_encode_flush().
+ *
+ * return code     number of bytes output in mp3buf. Can be 0
+ *                 -1:  mp3buf was too small
+ *                 -2:  malloc() problem
+ *                 -3:  lame_init_params() not called, or no source set
+ *                 -4:  psycho acoustic problems
+ *                 -7:  the source reported an error
+ *
+ * mp3buf_size = 0 disables the buffer check, like lame_encode_buffer().
+ * Otherwise mp3buf must hold at least 1.25*samples_per_frame + 7200
+ * octets (twice that when resampling), plus any pending ID3v2 tag.
+ */
+int CDECL lame_encode_run(
+        lame_global_flags*  gfp,
+        unsigned char*      mp3buf,
+        int                 mp3buf_size );
+
 
 
 
@@ -886,10 +954,90 @@ int CDECL lame_encode_flush_nogap(
  * Xing headers into the front of the bitstream, and sets frame counters
  * and bitrate histogram data to 0.  You can also call this after
  * lame_encode_flush_nogap().
+ *
+ * return code = 0 on success, -2 if the tags did not fit into the bit
+ * buffer (malloc() problem), -3 for an invalid gfp
  */
 int CDECL lame_init_bitstream(
         lame_global_flags *  gfp);    /* global context handle                 */
 
+/*
+ * OPTIONAL:
+ * Return a session to the state it had right after lame_init_params(),
+ * so it can encode a new, unrelated stream with the same settings.
+ * The configuration and all tables computed by lame_init_params() are
+ * kept, which makes this much cheaper than lame_close() + lame_init().
+ * Call it after lame_encode_flush() of the previous stream.
+ *
+ * return code = 0 on success, negative on error
+ */
+int CDECL lame_reset(
+        lame_global_flags *  gfp);    /* global context handle                 */
+
+/*
+ * OPTIONAL:
+ * memory held by a session, in bytes, by subsystem.  Valid at any time;
+ * after lame_init_params() all buffers needed for encoding are included,
+ * except the input buffer, which grows with the largest nsamples passed
+ * to lame_encode_buffer*(), and the resampler, ReplayGain analysis and
+ * decode-on-the-fly decoder, which are set up by the first encode call.
+ *
+ * return code = 0 on success, negative on error
+ */
+typedef struct {
+    size_t  total;          /* sum of all fields below                     */
+    size_t  session;        /* configuration and small state               */
+    size_t  input;          /* input buffers, frame buffer and resampler   */
+    size_t  psymodel;       /* psycho acoustic state, constants, ATH       */
+    size_t  quantizer;      /* side info, granule data, quantizer state    */
+    size_t  bitstream;      /* frame header ring and bit buffer            */
+    size_t  replaygain;     /* ReplayGain analysis, when enabled           */
+    size_t  tags;           /* ID3 tag data and VBR seek table             */
+    size_t  decoder;        /* decoder for decode-on-the-fly, when enabled */
+} lame_memory_usage;
+
+int CDECL lame_get_memory_usage(
+        const lame_global_flags *  gfp,   /* global context handle         */
+        lame_memory_usage *        usage);
+
+
+/*
+ * OPTIONAL:
+ * Session pool for applications starting and stopping many encoders with
+ * the same settings.  lame_pool_init() creates 'size' sessions from the
+ * parameters set on 'config' (lame_init_params() is called for each of
+ * them, not for 'config').  Keep one pool per distinct configuration.
+ *
+ * lame_pool_checkout() returns a ready-to-use session, or a newly created
+ * one if all pooled sessions are busy.  lame_pool_checkin() gives it back
+ * after lame_encode_flush(); pooled sessions are reset with lame_reset(),
+ * sessions created on the fly are closed.  A pooled session which cannot
+ * be reset is replaced; if that fails too, the slot stays free and gets a
+ * new session at its next checkout.  Checkout and checkin may be called
+ * from several threads at once without locking.
+ *
+ * Pooled sessions do not write ID3 tags automatically, use
+ * lame_get_id3v2_tag() / lame_get_id3v1_tag() to emit tags.
+ */
+typedef struct lame_pool_struct *lame_pool_t;
+
+typedef struct {
+    int size;                /* number of pooled sessions                   */
+    int in_use;              /* sessions currently checked out              */
+    int max_in_use;          /* highest number of concurrent checkouts      */
+    int checkouts;           /* number of successful checkouts              */
+    int misses;              /* checkouts served by a session created on
+                                the fly, because the pool was exhausted     */
+    int checkins;            /* number of checkins                          */
+    int failures;            /* sessions which could not be (re)initialized */
+} lame_pool_stats_t;
+
+lame_pool_t CDECL lame_pool_init(const lame_global_flags * config, int size);
+lame_t      CDECL lame_pool_checkout(lame_pool_t pool);
+int         CDECL lame_pool_checkin(lame_pool_t pool, lame_t gfp);
+int         CDECL lame_pool_get_stats(lame_pool_t pool, lame_pool_stats_t * stats);
+void        CDECL lame_pool_close(lame_pool_t pool);
+
 
 
 /*
@@ -904,6 +1052,10 @@ int CDECL lame_init_bitstream(
  *
  * attention: don't call them after lame_encode_finish
  * suggested: lame_encode_flush -> lame_*_hist -> lame_close
+ *
+ * the histograms are updated once per frame and may be read from another
+ * thread while encoding, without locking; each call returns the counts of
+ * whole frames, they never show a frame half counted
  */
 
 void CDECL lame_bitrate_hist(
@@ -928,6 +1080,18 @@ void CDECL lame_bitrate_block_type_hist (
         const lame_global_flags * gfp,
         int bitrate_btype_count[14][6] );
 
+/*
+ * how often vbr_mtrh had to squeeze a granule into its bit budget
+ *   0: granules over budget
+ *   1: fitted by flattening the scalefactor distribution
+ *   2: fitted by raising the flattened scalefactors
+ *   3: fitted by the global stepsize fallback
+ *   4: trial quantizations spent on the above
+ */
+void CDECL lame_vbr_recovery_hist (
+        const lame_global_flags * gfp,
+        int recovery_count[5] );
+
 #if (DEPRECATED_OR_OBSOLETE_CODE_REMOVED && 0)
 #else
 /*
@@ -1101,6 +1265,44 @@ int CDECL hip_decode1_headersB( hip_t gfp
                               , int             *enc_padding
                               );
 
+/*********************************************************************
+ * transcoding: decode mp3 data with 'hip' and encode it with 'gfp'.
+ *
+ * The decoded samples go to the encoder as floats, frame by frame,
+ * without a round trip through 16 bit PCM.  The decoder delay is
+ * removed, and if the source has a LAME tag, so are the encoder delay
+ * and padding of the source, which keeps the length of the audio.
+ *
+ * If lame_init_params() has not been called yet, the input sample rate
+ * and number of channels are taken from the first frame and
+ * lame_init_params() is called then; set all other parameters before.
+ * Otherwise they must match the source.
+ *
+ * Use a new hip_t for each source.  When lame_transcode_buffer() returns
+ * a value > 0 there may be decoded frames left: call it again with
+ * mp3in_size = 0 until it returns 0, before passing more input.  Finish
+ * with lame_encode_flush().
+ *
+ * return code     number of bytes output in mp3buf. Can be 0
+ *                 -1:  mp3buf was too small
+ *                 -2:  malloc() problem
+ *                 -3:  invalid arguments, or lame_init_params() failed
+ *                 -4:  psycho acoustic problems
+ *                 -7:  decoding error, or the source format changed
+ *
+ * mp3buf_size = 0 disables the buffer check, like lame_encode_buffer().
+ * Otherwise mp3buf must hold at least 1.25*samples_per_frame + 7200
+ * octets (times the resampling ratio when upsampling), plus any pending
+ * ID3v2 tag.
+ *********************************************************************/
+int CDECL lame_transcode_buffer( lame_t          gfp
+                               , hip_t           hip
+                               , unsigned char*  mp3in
+                               , size_t          mp3in_size
+                               , unsigned char*  mp3buf
+                               , int             mp3buf_size
+                               );
+
 
 
 /* OBSOLETE:
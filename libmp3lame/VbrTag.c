@@ -563,13 +563,14 @@ InitVbrTag(lame_global_flags * gfp)
     /* write dummy VBR tag of all 0's into bitstream */
     {
         uint8_t buffer[MAXFRAMESIZE];
-        size_t  i, n;
 
         memset(buffer, 0, sizeof(buffer));
         setLameTagFrameHeader(gfc, buffer);
-        n = gfc->VBR_seek_table.TotalFrameSize;
-        for (i = 0; i < n; ++i) {
-            add_dummy_byte(gfc, buffer[i], 1);
+        if (add_dummy_bytes(gfc, buffer, gfc->VBR_seek_table.TotalFrameSize) < 0) {
+            /* no room for the tag frame, so there is nothing to fill in later */
+            ERRORF(gfc, "Error: can't write the LAME tag frame\n");
+            gfc->cfg.write_lame_tag = 0;
+            return -1;
         }
     }
     /* Success */
@@ -128,6 +128,35 @@ get_max_frame_buffer_size_by_constraint(SessionConfig_t const * cfg, int constra
     return maxmp3buf;
 }
 
+/* largest number of bytes one call of format_bitstream() or flush_bitstream()
+   can add: a frame at the highest bitrate, plus a full bit reservoir */
+static int
+max_frame_bytes(SessionConfig_t const *cfg)
+{
+    int const max_kbps = cfg->free_format ? 640 : bitrate_table[cfg->version][14];
+    return calcFrameLength(cfg, max_kbps, 1) / 8 + 256 * cfg->mode_gr;
+}
+
+/* make room for n more bytes in the bit buffer */
+static int
+reserve_bit_stream(lame_internal_flags * gfc, int n)
+{
+    Bit_stream_struc *const bs = &gfc->bs;
+    int const needed = bs->buf_byte_idx + 2 + n;
+    unsigned char *buf;
+    int     size;
+
+    if (needed <= bs->buf_size)
+        return 0;
+    size = Max(needed, 2 * bs->buf_size);
+    buf = realloc(bs->buf, size);
+    if (buf == NULL)
+        return -1;
+    bs->buf = buf;
+    bs->buf_size = size;
+    return 0;
+}
+
 
 static void
 putheader_bits(lame_internal_flags * gfc)
@@ -162,7 +191,7 @@ putbits2(lame_internal_flags * gfc, int val, int j)
         if (bs->buf_bit_idx == 0) {
             bs->buf_bit_idx = 8;
             bs->buf_byte_idx++;
-            assert(bs->buf_byte_idx < BUFFER_SIZE);
+            assert(bs->buf_byte_idx < bs->buf_size);
             assert(esv->header[esv->w_ptr].write_timing >= bs->totbit);
             if (esv->header[esv->w_ptr].write_timing == bs->totbit) {
                 putheader_bits(gfc);
@@ -197,7 +226,7 @@ putbits_noheaders(lame_internal_flags * gfc, int val, int j)
         if (bs->buf_bit_idx == 0) {
             bs->buf_bit_idx = 8;
             bs->buf_byte_idx++;
-            assert(bs->buf_byte_idx < BUFFER_SIZE);
+            assert(bs->buf_byte_idx < bs->buf_size);
             bs->buf[bs->buf_byte_idx] = 0;
         }
 
@@ -859,7 +888,8 @@ compute_flushbits(const lame_internal_flags * gfc, int *total_bytes_output)
 }
 
 
-void
+/* returns 0, or -1 if the bit buffer cannot grow */
+int
 flush_bitstream(lame_internal_flags * gfc)
 {
     EncStateVar_t *const esv = &gfc->sv_enc;
@@ -873,7 +903,9 @@ flush_bitstream(lame_internal_flags * gfc)
 
 
     if ((flushbits = compute_flushbits(gfc, &nbytes)) < 0)
-        return;
+        return 0;
+    if (reserve_bit_stream(gfc, max_frame_bytes(&gfc->cfg)) != 0)
+        return -1;
     drain_into_ancillary(gfc, flushbits);
 
     /* check that the 100% of the last frame has been written to bitstream */
@@ -884,23 +916,49 @@ flush_bitstream(lame_internal_flags * gfc)
        same as filling the bitreservoir with ancillary data, so : */
     esv->ResvSize = 0;
     l3_side->main_data_begin = 0;
+    return 0;
 }
 
 
 
 
-void
+/* returns 0, or -1 if the bit buffer cannot grow */
+int
 add_dummy_byte(lame_internal_flags * gfc, unsigned char val, unsigned int n)
 {
     EncStateVar_t *const esv = &gfc->sv_enc;
     int     i;
 
-    while (n-- > 0u) {
+    unsigned int k;
+
+    if (reserve_bit_stream(gfc, (int) n) != 0)
+        return -1;
+    for (k = 0; k < n; ++k)
         putbits_noheaders(gfc, val, 8);
 
-        for (i = 0; i < MAX_HEADER_BUF; ++i)
-            esv->header[i].write_timing += 8;
-    }
+    /* pending headers move back by the whole run at once */
+    for (i = 0; i < MAX_HEADER_BUF; ++i)
+        esv->header[i].write_timing += 8 * (int) n;
+    return 0;
+}
+
+
+/* same as add_dummy_byte(), for a run of different bytes (tags) */
+int
+add_dummy_bytes(lame_internal_flags * gfc, unsigned char const *buf, unsigned int n)
+{
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    int     i;
+    unsigned int k;
+
+    if (reserve_bit_stream(gfc, (int) n) != 0)
+        return -1;
+    for (k = 0; k < n; ++k)
+        putbits_noheaders(gfc, buf[k], 8);
+
+    for (i = 0; i < MAX_HEADER_BUF; ++i)
+        esv->header[i].write_timing += 8 * (int) n;
+    return 0;
 }
 
 
@@ -924,6 +982,8 @@ format_bitstream(lame_internal_flags * gfc)
     int     bitsPerFrame;
     l3_side = &gfc->l3_side;
 
+    if (reserve_bit_stream(gfc, max_frame_bytes(cfg)) != 0)
+        return -1;
     bitsPerFrame = getframebits(gfc);
     drain_into_ancillary(gfc, l3_side->resvDrain_pre);
 
@@ -984,6 +1044,27 @@ format_bitstream(lame_internal_flags * gfc)
 }
 
 
+/* allocate the ReplayGain analysis when the first samples arrive,
+   return 0, or -2 when out of memory */
+int
+gain_analysis_start(lame_internal_flags * gfc)
+{
+    RpgStateVar_t *const rsv = &gfc->sv_rpg;
+
+    if (rsv->rgdata == NULL) {
+        rsv->rgdata = lame_calloc(replaygain_t, 1);
+        if (rsv->rgdata == NULL)
+            return -2;
+        if (InitGainAnalysis(rsv->rgdata, gfc->cfg.samplerate_out) == INIT_GAIN_ANALYSIS_ERROR) {
+            free(rsv->rgdata);
+            rsv->rgdata = NULL;
+            return -6;
+        }
+    }
+    return 0;
+}
+
+
 static int
 do_gain_analysis(lame_internal_flags * gfc, unsigned char* buffer, int minimum)
 {
@@ -996,6 +1077,21 @@ do_gain_analysis(lame_internal_flags * gfc, unsigned char* buffer, int minimum)
         int     mp3_in = minimum;
         int     samples_out = -1;
 
+        if (gfc->hip == 0) {
+            gfc->hip = hip_decode_init();
+            if (gfc->hip == 0)
+                return -2;
+            /* report functions */
+            hip_set_errorf(gfc->hip, gfc->report_err);
+            hip_set_debugf(gfc->hip, gfc->report_dbg);
+            hip_set_msgf(gfc->hip, gfc->report_msg);
+        }
+        if (cfg->findReplayGain) {
+            int const ret = gain_analysis_start(gfc);
+            if (ret < 0)
+                return ret;
+        }
+
         /* re-synthesis to pcm.  Repeat until we get a samples_out=0 */
         while (samples_out != 0) {
 
@@ -1097,12 +1193,15 @@ void
 init_bit_stream_w(lame_internal_flags * gfc)
 {
     EncStateVar_t *const esv = &gfc->sv_enc;
+    /* the VBR tag frame and the first frame; ID3v2 tags grow the buffer as needed */
+    int const size = 2 * max_frame_bytes(&gfc->cfg);
 
     esv->h_ptr = esv->w_ptr = 0;
     esv->header[esv->h_ptr].write_timing = 0;
 
-    gfc->bs.buf = lame_calloc(unsigned char, BUFFER_SIZE);
-    gfc->bs.buf_size = BUFFER_SIZE;
+    free(gfc->bs.buf);
+    gfc->bs.buf = lame_calloc(unsigned char, size);
+    gfc->bs.buf_size = gfc->bs.buf ? size : 0;
     gfc->bs.buf_byte_idx = -1;
     gfc->bs.buf_bit_idx = 0;
     gfc->bs.totbit = 0;
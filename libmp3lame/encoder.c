@@ -161,6 +161,10 @@ updateStats(lame_internal_flags * const gfc)
     assert(0 <= eov->bitrate_index && eov->bitrate_index < 16);
     assert(0 <= eov->mode_ext && eov->mode_ext < 4);
 
+    enc_stats_write_begin(eov);
+
+    ++eov->frame_number;
+
     /* count bitrate indices */
     eov->bitrate_channelmode_hist[eov->bitrate_index][4]++;
     eov->bitrate_channelmode_hist[15][4]++;
@@ -181,6 +185,9 @@ updateStats(lame_internal_flags * const gfc)
             eov->bitrate_blocktype_hist[15][5]++;
         }
     }
+    memcpy(eov->vbr_recovery_hist, gfc->sv_qnt.vbr_recovery_count, sizeof(eov->vbr_recovery_hist));
+
+    enc_stats_write_end(eov);
 }
 
 
@@ -541,7 +548,8 @@ lame_encode_mp3_frame(       /* Output */
 
 
     /*  write the frame to the bitstream  */
-    (void) format_bitstream(gfc);
+    if (format_bitstream(gfc) != 0)
+        return -2;      /* no memory for a bigger bit buffer */
 
     /* copy mp3 bit buffer into array */
     mp3count = copy_buffer(gfc, mp3buf, mp3buf_size, 1);
@@ -566,8 +574,6 @@ lame_encode_mp3_frame(       /* Output */
         set_frame_pinfo(gfc, masking);
     }
 
-    ++gfc->ov_enc.frame_number;
-
     updateStats(gfc);
 
     return mp3count;
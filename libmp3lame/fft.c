@@ -296,17 +296,23 @@ extern void fht_SSE(FLOAT * fz, int n);
 void
 init_fft(lame_internal_flags * const gfc)
 {
+    static int volatile init = 0;
     int     i;
 
-    /* The type of window used here will make no real difference, but */
-    /* in the interest of merging nspsytune stuff - switch to blackman window */
-    for (i = 0; i < BLKSIZE; i++)
-        /* blackman window */
-        window[i] = 0.42 - 0.5 * cos(2 * PI * (i + .5) / BLKSIZE) +
-            0.08 * cos(4 * PI * (i + .5) / BLKSIZE);
+    /* the windows are shared by all encoder instances, compute them once */
+    if (lame_once_begin(&init)) {
+        /* The type of window used here will make no real difference, but */
+        /* in the interest of merging nspsytune stuff - switch to blackman window */
+        for (i = 0; i < BLKSIZE; i++)
+            /* blackman window */
+            window[i] = 0.42 - 0.5 * cos(2 * PI * (i + .5) / BLKSIZE) +
+                0.08 * cos(4 * PI * (i + .5) / BLKSIZE);
 
-    for (i = 0; i < BLKSIZE_s / 2; i++)
-        window_s[i] = 0.5 * (1.0 - cos(2.0 * PI * (i + 0.5) / BLKSIZE_s));
+        for (i = 0; i < BLKSIZE_s / 2; i++)
+            window_s[i] = 0.5 * (1.0 - cos(2.0 * PI * (i + 0.5) / BLKSIZE_s));
+
+        lame_once_end(&init);
+    }
 
     gfc->fft_fht = fht;
 #ifdef HAVE_NASM
@@ -189,6 +189,25 @@ filterButter(const Float_t * input, Float_t * output, size_t nSamples, const Flo
     }
 }
 
+/* After the input goes digitally silent the IIR filters keep ringing
+ * down until their history is made of denormals, which are very slow
+ * on many FPUs. Once the whole history of a channel has decayed far
+ * below anything a 16 bit sample can express, snap it to zero. */
+
+#define SILENT_HISTORY 1e-10
+
+static void
+flushSilentHistory(Float_t * stepbuf, Float_t * outbuf)
+{
+    int     i;
+    for (i = 0; i < MAX_ORDER; ++i) {
+        if (fabs(stepbuf[i]) > SILENT_HISTORY || fabs(outbuf[i]) > SILENT_HISTORY)
+            return;
+    }
+    memset(stepbuf, 0, MAX_ORDER * sizeof(*stepbuf));
+    memset(outbuf, 0, MAX_ORDER * sizeof(*outbuf));
+}
+
 
 
 static int ResetSampleFrequency(replaygain_t * rgData, long samplefreq);
@@ -383,6 +402,8 @@ AnalyzeSamples(replaygain_t * rgData, const Float_t * left_samples, const Float_
                     MAX_ORDER * sizeof(Float_t));
             memmove(rgData->rstepbuf, rgData->rstepbuf + rgData->totsamp,
                     MAX_ORDER * sizeof(Float_t));
+            flushSilentHistory(rgData->lstepbuf, rgData->loutbuf);
+            flushSilentHistory(rgData->rstepbuf, rgData->routbuf);
             rgData->totsamp = 0;
         }
         if (rgData->totsamp > rgData->sampleWindow) /* somehow I really screwed up: Error in programming! Contact author about totsamp > sampleWindow */
@@ -1732,10 +1732,10 @@ id3tag_write_v2(lame_t gfp)
             return -1;
         }
         else {
-            size_t  i;
             /* write tag directly into bitstream at current position */
-            for (i = 0; i < tag_size; ++i) {
-                add_dummy_byte(gfc, tag[i], 1);
+            if (add_dummy_bytes(gfc, tag, (unsigned int) tag_size) < 0) {
+                free(tag);
+                return -1;
             }
         }
         free(tag);
@@ -1812,7 +1812,7 @@ int
 id3tag_write_v1(lame_t gfp)
 {
     lame_internal_flags *const gfc = gfp->internal_flags;
-    size_t  i, n, m;
+    size_t  n, m;
     unsigned char tag[128];
 
     m = sizeof(tag);
@@ -1821,8 +1821,8 @@ id3tag_write_v1(lame_t gfp)
         return 0;
     }
     /* write tag directly into bitstream at current position */
-    for (i = 0; i < n; ++i) {
-        add_dummy_byte(gfc, tag[i], 1);
+    if (add_dummy_bytes(gfc, tag, (unsigned int) n) < 0) {
+        return -1;
     }
     return (int) n;     /* ok, tag has fixed size of 128 bytes, well below 2GB */
 }
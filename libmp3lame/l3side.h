@@ -44,12 +44,14 @@ typedef struct {
     III_psy_xmin en;
 } III_psy_ratio;
 
+/*
+ * The members of gr_info are grouped by how often they change: the side
+ * info and the scalefactors change with every quantization step, l3_enc
+ * with every bit count, the rest is fixed once the granule is set up for
+ * quantization (init_outer_loop, calc_xmin).  Copies of a granule under
+ * quantization only need to move the changing part, GR_INFO_STATE_SIZE.
+ */
 typedef struct {
-    FLOAT   xr[576];
-    int     l3_enc[576];
-    int     scalefac[SFBMAX];
-    FLOAT   xrpow_max;
-
     int     part2_3_length;
     int     big_values;
     int     count1;
@@ -66,23 +68,34 @@ typedef struct {
     int     count1table_select;
 
     int     part2_length;
+    int     count1bits;
+    /* added for LSF */
+    const int *sfb_partition_table;
+    int     slen[4];
+    FLOAT   xrpow_max;
+
+    int     scalefac[SFBMAX];
+    int     l3_enc[576];
+
+    /* granule layout, fixed during quantization */
+    FLOAT   xr[576];
     int     sfb_lmax;
     int     sfb_smin;
     int     psy_lmax;
     int     sfbmax;
     int     psymax;
     int     sfbdivide;
-    int     width[SFBMAX];
-    int     window[SFBMAX];
-    int     count1bits;
-    /* added for LSF */
-    const int *sfb_partition_table;
-    int     slen[4];
+    int const *width;        /* SFBMAX entries, shared per block type */
+    int const *window;       /* SFBMAX entries, shared per block type */
 
     int     max_nonzero_coeff;
     char    energy_above_cutoff[SFBMAX];
 } gr_info;
 
+/* bytes of gr_info that change while quantizing, with and without l3_enc */
+#define GR_INFO_STATE_SIZE  offsetof(gr_info, xr)
+#define GR_INFO_SIDE_SIZE   offsetof(gr_info, l3_enc)
+
 typedef struct {
     gr_info tt[2][2];
     int     main_data_begin;
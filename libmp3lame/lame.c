@@ -537,7 +537,8 @@ linear_int(double a, double b, double m)
 int
 lame_init_params(lame_global_flags * gfp)
 {
-
+    double const start = wall_clock_seconds();
+    double  t;
     int     i;
     int     j;
     lame_internal_flags *gfc;
@@ -916,8 +917,17 @@ lame_init_params(lame_global_flags * gfp)
         gfc->ov_enc.bitrate_index = 1;
     }
 
+    t = wall_clock_seconds();
     init_bit_stream_w(gfc);
 
+    /* frame buffer, one row per output channel */
+    free(gfc->sv_enc.mfbuf[0]);
+    gfc->sv_enc.mfbuf[0] = lame_calloc(sample_t, cfg->channels_out * MFSIZE);
+    if (gfc->sv_enc.mfbuf[0] == NULL)
+        return -2;
+    gfc->sv_enc.mfbuf[1] = gfc->sv_enc.mfbuf[0] + (cfg->channels_out - 1) * MFSIZE;
+    gfc->init_time.buffers = wall_clock_seconds() - t;
+
     j = cfg->samplerate_index + (3 * cfg->version) + 6 * (cfg->samplerate_out < 16000);
     for (i = 0; i < SBMAX_l + 1; i++)
         gfc->scalefac_band.l[i] = sfBandIndex[j].l[i];
@@ -1240,10 +1250,19 @@ lame_init_params(lame_global_flags * gfp)
         gfc->sv_enc.slot_lag = gfc->sv_enc.frac_SpF
             = ((cfg->version + 1) * 72000L * cfg->avg_bitrate) % cfg->samplerate_out;
 
-    (void) lame_init_bitstream(gfp);
+    t = wall_clock_seconds();
+    if (lame_init_bitstream(gfp) < 0) {
+        return -2;
+    }
+    gfc->init_time.tags = wall_clock_seconds() - t;
 
+    t = wall_clock_seconds();
     iteration_init(gfc);
+    gfc->init_time.tables = wall_clock_seconds() - t;
+
+    t = wall_clock_seconds();
     (void) psymodel_init(gfp);
+    gfc->init_time.psymodel = wall_clock_seconds() - t;
 
     cfg->buffer_constraint = get_max_frame_buffer_size_by_constraint(cfg, gfp->strict_ISO);
 
@@ -1262,24 +1281,20 @@ lame_init_params(lame_global_flags * gfp)
     if (cfg->decode_on_the_fly)
         cfg->findPeakSample = 1;
 
-    if (cfg->findReplayGain) {
-        if (InitGainAnalysis(gfc->sv_rpg.rgdata, cfg->samplerate_out) == INIT_GAIN_ANALYSIS_ERROR) {
-            return -6;
-        }
+    /* The ReplayGain analysis (130 KB) and the decoder for decode-on-the-fly
+       are set up by the first frame that needs them, like the resampler.
+       Only restart what an earlier lame_init_params() call left behind. */
+    if (gfc->sv_rpg.rgdata != NULL) {
+        free(gfc->sv_rpg.rgdata);
+        gfc->sv_rpg.rgdata = NULL;
     }
-
 #ifdef DECODE_ON_THE_FLY
-    if (cfg->decode_on_the_fly && !gfp->decode_only) {
-        if (gfc->hip) {
-            hip_decode_exit(gfc->hip);
-        }
-        gfc->hip = hip_decode_init();
-        /* report functions */
-        hip_set_errorf(gfc->hip, gfp->report.errorf);
-        hip_set_debugf(gfc->hip, gfp->report.debugf);
-        hip_set_msgf(gfc->hip, gfp->report.msgf);
+    if (gfc->hip) {
+        hip_decode_exit(gfc->hip);
+        gfc->hip = 0;
     }
 #endif
+    gfc->init_time.total = wall_clock_seconds() - start;
     return 0;
 }
 
@@ -1556,6 +1571,40 @@ lame_print_internals(const lame_global_flags * gfp)
     MSGF(gfc, "\tinterchannel masking ratio: %g\n", cfg->interChRatio);
     MSGF(gfc, "\t...\n");
 
+    /*  time spent in lame_init_params
+     */
+    {
+        double const us = 1e6;
+        double const rest = gfc->init_time.total - gfc->init_time.buffers - gfc->init_time.tags
+            - gfc->init_time.tables - gfc->init_time.psymodel;
+        MSGF(gfc, "\nstartup:\n\n");
+        MSGF(gfc, "\ttotal: %.0f us\n", gfc->init_time.total * us);
+        MSGF(gfc, "\t ^ configuration: %.0f\n", rest * us);
+        MSGF(gfc, "\t ^ buffers: %.0f\n", gfc->init_time.buffers * us);
+        MSGF(gfc, "\t ^ tags: %.0f\n", gfc->init_time.tags * us);
+        MSGF(gfc, "\t ^ tables: %.0f\n", gfc->init_time.tables * us);
+        MSGF(gfc, "\t ^ psymodel: %.0f\n", gfc->init_time.psymodel * us);
+        MSGF(gfc, "\t resampler, ReplayGain and decoder: on first use\n");
+    }
+
+    /*  memory held by this session
+     */
+    {
+        lame_memory_usage mem;
+        if (lame_get_memory_usage(gfp, &mem) == 0) {
+            MSGF(gfc, "\nmemory:\n\n");
+            MSGF(gfc, "\ttotal: %lu bytes\n", (unsigned long) mem.total);
+            MSGF(gfc, "\t ^ session: %lu\n", (unsigned long) mem.session);
+            MSGF(gfc, "\t ^ input: %lu\n", (unsigned long) mem.input);
+            MSGF(gfc, "\t ^ psymodel: %lu\n", (unsigned long) mem.psymodel);
+            MSGF(gfc, "\t ^ quantizer: %lu\n", (unsigned long) mem.quantizer);
+            MSGF(gfc, "\t ^ bitstream: %lu\n", (unsigned long) mem.bitstream);
+            MSGF(gfc, "\t ^ replaygain: %lu\n", (unsigned long) mem.replaygain);
+            MSGF(gfc, "\t ^ tags: %lu\n", (unsigned long) mem.tags);
+            MSGF(gfc, "\t ^ decoder: %lu\n", (unsigned long) mem.decoder);
+        }
+    }
+
     /*  that's all ?
      */
     MSGF(gfc, "\n");
@@ -1570,7 +1619,7 @@ save_gain_values(lame_internal_flags * gfc)
     RpgStateVar_t const *const rsv = &gfc->sv_rpg;
     RpgResult_t *const rov = &gfc->ov_rpg;
     /* save the ReplayGain value */
-    if (cfg->findReplayGain) {
+    if (cfg->findReplayGain && rsv->rgdata != NULL) {
         FLOAT const RadioGain = (FLOAT) GetTitleGain(rsv->rgdata);
         if (NEQ(RadioGain, GAIN_NOT_ENOUGH_SAMPLES)) {
             rov->RadioGain = (int) floor(RadioGain * 10.0 + 0.5); /* round to nearest */
@@ -1650,6 +1699,109 @@ calcNeeded(SessionConfig_t const * cfg)
 }
 
 
+/*
+ * account for n_out new samples appended to mfbuf at mf_size, and
+ * encode one frame if mfbuf holds enough samples.
+ *
+ * buf_size is the space left in mp3buf, 0 means no check.
+ *
+ * return code = number of bytes output in mp3buf, or negative on error
+ */
+static int
+lame_encode_buffer_commit(lame_internal_flags * gfc, int n_out,
+                          unsigned char *mp3buf, int buf_size)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    int const pcm_samples_per_frame = 576 * cfg->mode_gr;
+    int const mf_needed = calcNeeded(cfg);
+    sample_t *mfbuf[2];
+    int     ret = 0, i, ch;
+
+    mfbuf[0] = esv->mfbuf[0];
+    mfbuf[1] = esv->mfbuf[1];
+
+    /* compute ReplayGain of resampled input if requested */
+    if (cfg->findReplayGain && !cfg->decode_on_the_fly) {
+        ret = gain_analysis_start(gfc);
+        if (ret < 0)
+            return ret;
+        if (AnalyzeSamples
+            (gfc->sv_rpg.rgdata, &mfbuf[0][esv->mf_size], &mfbuf[1][esv->mf_size], n_out,
+             cfg->channels_out) == GAIN_ANALYSIS_ERROR)
+            return -6;
+    }
+
+    /* update mfbuf[] counters */
+    esv->mf_size += n_out;
+    assert(esv->mf_size <= MFSIZE);
+
+    /* lame_encode_flush may have set gfc->mf_sample_to_encode to 0
+     * so we have to reinitialize it here when that happened.
+     */
+    if (esv->mf_samples_to_encode < 1) {
+        esv->mf_samples_to_encode = ENCDELAY + POSTDELAY;
+    }
+    esv->mf_samples_to_encode += n_out;
+
+
+    if (esv->mf_size >= mf_needed) {
+        /* encode the frame.  */
+        ret = lame_encode_mp3_frame(gfc, mfbuf[0], mfbuf[1], mp3buf, buf_size);
+        if (ret < 0)
+            return ret;
+
+        /* shift out old samples */
+        esv->mf_size -= pcm_samples_per_frame;
+        esv->mf_samples_to_encode -= pcm_samples_per_frame;
+        for (ch = 0; ch < cfg->channels_out; ch++)
+            for (i = 0; i < esv->mf_size; i++)
+                mfbuf[ch][i] = mfbuf[ch][i + pcm_samples_per_frame];
+    }
+    return ret;
+}
+
+
+/*
+ * one step of lame_encode_buffer_sample_t():
+ * move samples from in_buffer into mfbuf (with resampling) and encode
+ * one frame if mfbuf holds enough samples.
+ *
+ * in_buffer and nsamples are advanced by the number of samples consumed.
+ * buf_size is the space left in mp3buf, 0 means no check.
+ *
+ * return code = number of bytes output in mp3buf, or negative on error
+ */
+static int
+lame_encode_buffer_step(lame_internal_flags * gfc, sample_t const *in_buffer[2], int *nsamples,
+                        unsigned char *mp3buf, int buf_size)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    sample_t *mfbuf[2];
+    sample_t const *in_buffer_ptr[2];
+    int     n_in = 0;        /* number of input samples processed with fill_buffer */
+    int     n_out = 0;       /* number of samples output with fill_buffer */
+    /* n_in <> n_out if we are resampling */
+
+    mfbuf[0] = esv->mfbuf[0];
+    mfbuf[1] = esv->mfbuf[1];
+
+    in_buffer_ptr[0] = in_buffer[0];
+    in_buffer_ptr[1] = in_buffer[1];
+    /* copy in new samples into mfbuf, with resampling */
+    fill_buffer(gfc, mfbuf, &in_buffer_ptr[0], *nsamples, &n_in, &n_out);
+
+    /* update in_buffer counters */
+    *nsamples -= n_in;
+    in_buffer[0] += n_in;
+    if (cfg->channels_out == 2)
+        in_buffer[1] += n_in;
+
+    return lame_encode_buffer_commit(gfc, n_out, mp3buf, buf_size);
+}
+
+
 /*
  * THE MAIN LAME ENCODING INTERFACE
  * mt 3/00
@@ -1674,13 +1826,10 @@ static int
 lame_encode_buffer_sample_t(lame_internal_flags * gfc,
                             int nsamples, unsigned char *mp3buf, const int mp3buf_size)
 {
-    SessionConfig_t const *const cfg = &gfc->cfg;
     EncStateVar_t *const esv = &gfc->sv_enc;
-    int     pcm_samples_per_frame = 576 * cfg->mode_gr;
-    int     mp3size = 0, ret, i, ch, mf_needed;
+    int     mp3size = 0, ret;
     int     mp3out;
-    sample_t *mfbuf[2];
-    sample_t *in_buffer[2];
+    sample_t const *in_buffer[2];
 
     if (gfc->class_id != LAME_ID)
         return -3;
@@ -1698,78 +1847,25 @@ lame_encode_buffer_sample_t(lame_internal_flags * gfc,
     in_buffer[0] = esv->in_buffer_0;
     in_buffer[1] = esv->in_buffer_1;
 
-    mf_needed = calcNeeded(cfg);
-
-    mfbuf[0] = esv->mfbuf[0];
-    mfbuf[1] = esv->mfbuf[1];
-
     while (nsamples > 0) {
-        sample_t const *in_buffer_ptr[2];
-        int     n_in = 0;    /* number of input samples processed with fill_buffer */
-        int     n_out = 0;   /* number of samples output with fill_buffer */
-        /* n_in <> n_out if we are resampling */
-
-        in_buffer_ptr[0] = in_buffer[0];
-        in_buffer_ptr[1] = in_buffer[1];
-        /* copy in new samples into mfbuf, with resampling */
-        fill_buffer(gfc, mfbuf, &in_buffer_ptr[0], nsamples, &n_in, &n_out);
-
-        /* compute ReplayGain of resampled input if requested */
-        if (cfg->findReplayGain && !cfg->decode_on_the_fly)
-            if (AnalyzeSamples
-                (gfc->sv_rpg.rgdata, &mfbuf[0][esv->mf_size], &mfbuf[1][esv->mf_size], n_out,
-                 cfg->channels_out) == GAIN_ANALYSIS_ERROR)
-                return -6;
-
-
-
-        /* update in_buffer counters */
-        nsamples -= n_in;
-        in_buffer[0] += n_in;
-        if (cfg->channels_out == 2)
-            in_buffer[1] += n_in;
-
-        /* update mfbuf[] counters */
-        esv->mf_size += n_out;
-        assert(esv->mf_size <= MFSIZE);
-        
-        /* lame_encode_flush may have set gfc->mf_sample_to_encode to 0
-         * so we have to reinitialize it here when that happened.
-         */
-        if (esv->mf_samples_to_encode < 1) {
-            esv->mf_samples_to_encode = ENCDELAY + POSTDELAY;
-        }        
-        esv->mf_samples_to_encode += n_out;
-
-
-        if (esv->mf_size >= mf_needed) {
-            /* encode the frame.  */
-            /* mp3buf              = pointer to current location in buffer */
-            /* mp3buf_size         = size of original mp3 output buffer */
-            /*                     = 0 if we should not worry about the */
-            /*                       buffer size because calling program is  */
-            /*                       to lazy to compute it */
-            /* mp3size             = size of data written to buffer so far */
-            /* mp3buf_size-mp3size = amount of space avalable  */
-
-            int     buf_size = mp3buf_size - mp3size;
-            if (mp3buf_size == 0)
-                buf_size = 0;
+        /* mp3buf              = pointer to current location in buffer */
+        /* mp3buf_size         = size of original mp3 output buffer */
+        /*                     = 0 if we should not worry about the */
+        /*                       buffer size because calling program is  */
+        /*                       to lazy to compute it */
+        /* mp3size             = size of data written to buffer so far */
+        /* mp3buf_size-mp3size = amount of space avalable  */
 
-            ret = lame_encode_mp3_frame(gfc, mfbuf[0], mfbuf[1], mp3buf, buf_size);
+        int     buf_size = mp3buf_size - mp3size;
+        if (mp3buf_size == 0)
+            buf_size = 0;
 
-            if (ret < 0)
-                return ret;
-            mp3buf += ret;
-            mp3size += ret;
+        ret = lame_encode_buffer_step(gfc, in_buffer, &nsamples, mp3buf, buf_size);
 
-            /* shift out old samples */
-            esv->mf_size -= pcm_samples_per_frame;
-            esv->mf_samples_to_encode -= pcm_samples_per_frame;
-            for (ch = 0; ch < cfg->channels_out; ch++)
-                for (i = 0; i < esv->mf_size; i++)
-                    mfbuf[ch][i] = mfbuf[ch][i + pcm_samples_per_frame];
-        }
+        if (ret < 0)
+            return ret;
+        mp3buf += ret;
+        mp3size += ret;
     }
     assert(nsamples == 0);
 
@@ -1837,10 +1933,39 @@ lame_copy_inbuffer(lame_internal_flags* gfc,
 }
 
 
+/* denormal flushing as requested for this session, see util.c;
+ * the outermost call remembers both modes for fpu_callback_begin() */
+static fpu_mode_t
+encoder_fpu_enter(lame_global_flags const *gfp)
+{
+    fpu_mode_t const fpu = fpu_flush_denormals_enter(is_lame_global_flags_valid(gfp)
+                                                     && gfp->flush_denormals);
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags *const gfc = gfp->internal_flags;
+        if (is_lame_internal_flags_valid(gfc) && gfc->fpu.depth++ == 0) {
+            gfc->fpu.caller = fpu;
+            gfc->fpu.inside = fpu_flush_denormals_enter(0);
+        }
+    }
+    return fpu;
+}
+
+static void
+encoder_fpu_leave(lame_global_flags const *gfp, fpu_mode_t fpu)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags *const gfc = gfp->internal_flags;
+        if (is_lame_internal_flags_valid(gfc) && gfc->fpu.depth > 0)
+            --gfc->fpu.depth;
+    }
+    fpu_flush_denormals_leave(fpu);
+}
+
+
 static int
-lame_encode_buffer_template(lame_global_flags * gfp,
-                            void const* buffer_l, void const* buffer_r, const int nsamples,
-                            unsigned char *mp3buf, const int mp3buf_size, enum PCMSampleType pcm_type, int aa, FLOAT norm)
+encode_buffer_template(lame_global_flags * gfp,
+                       void const* buffer_l, void const* buffer_r, const int nsamples,
+                       unsigned char *mp3buf, const int mp3buf_size, enum PCMSampleType pcm_type, int aa, FLOAT norm)
 {
     if (is_lame_global_flags_valid(gfp)) {
         lame_internal_flags *const gfc = gfp->internal_flags;
@@ -1873,6 +1998,18 @@ lame_encode_buffer_template(lame_global_flags * gfp,
     return -3;
 }
 
+static int
+lame_encode_buffer_template(lame_global_flags * gfp,
+                            void const* buffer_l, void const* buffer_r, const int nsamples,
+                            unsigned char *mp3buf, const int mp3buf_size, enum PCMSampleType pcm_type, int aa, FLOAT norm)
+{
+    fpu_mode_t const fpu = encoder_fpu_enter(gfp);
+    int const ret = encode_buffer_template(gfp, buffer_l, buffer_r, nsamples,
+                                           mp3buf, mp3buf_size, pcm_type, aa, norm);
+    encoder_fpu_leave(gfp, fpu);
+    return ret;
+}
+
 int
 lame_encode_buffer(lame_global_flags * gfp,
                    const short int pcm_l[], const short int pcm_r[], const int nsamples,
@@ -1975,6 +2112,161 @@ lame_encode_buffer_interleaved(lame_global_flags * gfp,
 }
 
 
+int
+lame_encode_buffer_strided_int(lame_t gfp,
+                               const int pcm[], int stride, const int nsamples,
+                               unsigned char *mp3buf, const int mp3buf_size)
+{
+    /* input is assumed to be normalized to +/- MAX_INT for full scale */
+    FLOAT const norm = (1.0 / (1L << (8 * sizeof(int) - 16)));
+    if (!is_lame_global_flags_valid(gfp) || stride < gfp->num_channels) {
+        return -3;
+    }
+    return lame_encode_buffer_template(gfp, pcm, pcm+1, nsamples, mp3buf, mp3buf_size, pcm_int_type, stride, norm);
+}
+
+
+
+int
+lame_set_pcm_source(lame_global_flags * gfp, lame_pcm_source_function func, void *data)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        gfp->pcm_source.func = func;
+        gfp->pcm_source.data = data;
+        return 0;
+    }
+    return -1;
+}
+
+
+/*
+ * lame_encode_run: pull PCM from the source set by lame_set_pcm_source().
+ *
+ * Without resampling, channel mixing or scaling the source writes straight
+ * into mfbuf, exactly the samples still missing for the next frame.
+ * Otherwise it writes into in_buffer and the samples take the same path
+ * as lame_encode_buffer_float() input.
+ */
+static int
+encode_run(lame_global_flags * gfp, unsigned char *mp3buf, int mp3buf_size)
+{
+    lame_internal_flags *gfc;
+    SessionConfig_t const *cfg;
+    EncStateVar_t *esv;
+    lame_pcm_source_function func;
+    int     pcm_samples_per_frame, mf_needed, frame_size_max, direct, in_samples;
+    int     mp3size = 0, mp3out, ret;
+
+    if (!is_lame_global_flags_valid(gfp))
+        return -3;
+    gfc = gfp->internal_flags;
+    if (!is_lame_internal_flags_valid(gfc))
+        return -3;
+    func = gfp->pcm_source.func;
+    if (func == 0)
+        return -3;
+    cfg = &gfc->cfg;
+    esv = &gfc->sv_enc;
+    pcm_samples_per_frame = 576 * cfg->mode_gr;
+    mf_needed = calcNeeded(cfg);
+    /* worst case output of one frame, see lame_encode_buffer() */
+    frame_size_max = (5 * pcm_samples_per_frame) / 4 + 7200;
+
+    direct = !isResamplingNecessary(cfg)
+        && cfg->channels_in == cfg->channels_out
+        && cfg->pcm_transform[0][0] == 1 && cfg->pcm_transform[0][1] == 0
+        && cfg->pcm_transform[1][0] == 0 && cfg->pcm_transform[1][1] == 1;
+
+    /* input for about one frame of output when going through in_buffer */
+    in_samples = (int) (((double) pcm_samples_per_frame * cfg->samplerate_in
+                         + cfg->samplerate_out - 1) / cfg->samplerate_out);
+    if (!direct) {
+        if (update_inbuffer_size(gfc, in_samples) != 0)
+            return -2;
+        /* with resampling one pull may complete two frames */
+        frame_size_max *= 2;
+    }
+
+    /* copy out any tags that may have been written into bitstream */
+    mp3out = copy_buffer(gfc, mp3buf, mp3buf_size, 0);
+    if (mp3out < 0)
+        return mp3out;  /* not enough buffer space */
+    mp3buf += mp3out;
+    mp3size += mp3out;
+
+    while (mp3buf_size == 0 || mp3buf_size - mp3size >= frame_size_max) {
+        int     buf_size = mp3buf_size - mp3size;
+        int     n;
+
+        if (mp3buf_size == 0)
+            buf_size = 0;
+
+        if (direct) {
+            int const mf_size = esv->mf_size;
+            float  *pcm_r = 0;
+            int     nsamples = mf_needed - mf_size;
+
+            if (cfg->channels_in > 1)
+                pcm_r = &esv->mfbuf[1][mf_size];
+            fpu_callback_begin(gfc);
+            n = func(gfp->pcm_source.data, &esv->mfbuf[0][mf_size], pcm_r, nsamples);
+            fpu_callback_end(gfc);
+            if (n < 0)
+                return -7;
+            if (n == 0)
+                break;
+            if (n > nsamples)
+                n = nsamples;
+            ret = lame_encode_buffer_commit(gfc, n, mp3buf, buf_size);
+        }
+        else {
+            sample_t *const ib0 = esv->in_buffer_0;
+            sample_t *const ib1 = esv->in_buffer_1;
+            sample_t const *in_buffer[2];
+
+            fpu_callback_begin(gfc);
+            n = func(gfp->pcm_source.data, ib0, cfg->channels_in > 1 ? ib1 : 0, in_samples);
+            fpu_callback_end(gfc);
+            if (n < 0)
+                return -7;
+            if (n == 0)
+                break;
+            if (n > in_samples)
+                n = in_samples;
+            /* mixing and scaling, in place */
+            lame_copy_inbuffer(gfc, ib0, cfg->channels_in > 1 ? ib1 : ib0, n,
+                               pcm_float_type, 1, 1.0);
+            in_buffer[0] = ib0;
+            in_buffer[1] = ib1;
+            ret = 0;
+            while (n > 0) {
+                int const r = lame_encode_buffer_step(gfc, in_buffer, &n, mp3buf + ret,
+                                                      buf_size == 0 ? 0 : buf_size - ret);
+                if (r < 0) {
+                    ret = r;
+                    break;
+                }
+                ret += r;
+            }
+        }
+        if (ret < 0)
+            return ret;
+        mp3buf += ret;
+        mp3size += ret;
+    }
+    return mp3size;
+}
+
+int
+lame_encode_run(lame_global_flags * gfp, unsigned char *mp3buf, int mp3buf_size)
+{
+    fpu_mode_t const fpu = encoder_fpu_enter(gfp);
+    int const ret = encode_run(gfp, mp3buf, mp3buf_size);
+    encoder_fpu_leave(gfp, fpu);
+    return ret;
+}
+
+
 
 
 /*****************************************************************
@@ -1993,9 +2285,15 @@ lame_encode_flush_nogap(lame_global_flags * gfp, unsigned char *mp3buffer, int m
     if (is_lame_global_flags_valid(gfp)) {
         lame_internal_flags *const gfc = gfp->internal_flags;
         if (is_lame_internal_flags_valid(gfc)) {
-            flush_bitstream(gfc);
-            rc = copy_buffer(gfc, mp3buffer, mp3buffer_size, 1);
-            save_gain_values(gfc);
+            fpu_mode_t const fpu = encoder_fpu_enter(gfp);
+            if (flush_bitstream(gfc) < 0) {
+                rc = -2;
+            }
+            else {
+                rc = copy_buffer(gfc, mp3buffer, mp3buffer_size, 1);
+                save_gain_values(gfc);
+            }
+            encoder_fpu_leave(gfp, fpu);
         }
     }
     return rc;
@@ -2010,38 +2308,172 @@ lame_init_bitstream(lame_global_flags * gfp)
     if (is_lame_global_flags_valid(gfp)) {
         lame_internal_flags *const gfc = gfp->internal_flags;
         if (gfc != 0) {
-            gfc->ov_enc.frame_number = 0;
-
+            int     ret = 0;
             if (gfp->write_id3tag_automatic) {
-                (void) id3tag_write_v2(gfp);
+                if (id3tag_write_v2(gfp) < 0)
+                    ret = -2;
             }
             /* initialize histogram data optionally used by frontend */
+            enc_stats_write_begin(&gfc->ov_enc);
+            gfc->ov_enc.frame_number = 0;
             memset(gfc->ov_enc.bitrate_channelmode_hist, 0,
                    sizeof(gfc->ov_enc.bitrate_channelmode_hist));
             memset(gfc->ov_enc.bitrate_blocktype_hist, 0,
                    sizeof(gfc->ov_enc.bitrate_blocktype_hist));
+            memset(gfc->ov_enc.vbr_recovery_hist, 0,
+                   sizeof(gfc->ov_enc.vbr_recovery_hist));
+            memset(gfc->sv_qnt.vbr_recovery_count, 0,
+                   sizeof(gfc->sv_qnt.vbr_recovery_count));
+            enc_stats_write_end(&gfc->ov_enc);
 
             gfc->ov_rpg.PeakSample = 0.0;
 
             /* Write initial VBR Header to bitstream and init VBR data */
-            if (gfc->cfg.write_lame_tag)
-                (void) InitVbrTag(gfp);
-
+            if (gfc->cfg.write_lame_tag) {
+                if (InitVbrTag(gfp) < 0)
+                    ret = -2;
+            }
 
-            return 0;
+            return ret;
         }
     }
     return -3;
 }
 
 
+/* return an initialized session to the state it had right after
+   lame_init_params(), without recomputing the configuration and tables */
+int
+lame_reset(lame_global_flags * gfp)
+{
+    lame_internal_flags *gfc;
+    SessionConfig_t const *cfg;
+    EncStateVar_t *esv;
+    int     k;
+
+    if (!is_lame_global_flags_valid(gfp))
+        return -3;
+    gfc = gfp->internal_flags;
+    if (!is_lame_internal_flags_valid(gfc))
+        return -3;
+    cfg = &gfc->cfg;
+    esv = &gfc->sv_enc;
+
+    gfc->lame_encode_frame_init = 0;
+
+    /* bitstream, header buffer and reservoir */
+    memset(esv->header, 0, sizeof(esv->header));
+    esv->h_ptr = esv->w_ptr = 0;
+    esv->ancillary_flag = 0;
+    esv->ResvSize = 0;
+    esv->ResvMax = 0;
+    gfc->bs.buf_byte_idx = -1;
+    gfc->bs.buf_bit_idx = 0;
+    gfc->bs.totbit = 0;
+    memset(&gfc->l3_side, 0, sizeof(gfc->l3_side));
+
+    /* input buffering, resampler and filterbank */
+    memset(esv->sb_sample, 0, sizeof(esv->sb_sample));
+    memset(esv->mfbuf[0], 0, cfg->channels_out * MFSIZE * sizeof(sample_t));
+    esv->mf_samples_to_encode = ENCDELAY + POSTDELAY;
+    esv->mf_size = ENCDELAY - MDCTDELAY; /* we pad input with this many 0's */
+    esv->slot_lag = esv->frac_SpF;
+    for (k = 0; k < 19; k++)
+        esv->pefirbuf[k] = 700 * cfg->mode_gr * cfg->channels_out;
+    fill_buffer_reset(gfc);
+
+    /* psymodel and quantization loop */
+    psymodel_reset(gfc);
+    gfc->sv_qnt.OldValue[0] = 180;
+    gfc->sv_qnt.OldValue[1] = 180;
+    gfc->sv_qnt.CurrentStep[0] = 4;
+    gfc->sv_qnt.CurrentStep[1] = 4;
+    gfc->sv_qnt.masking_lower = 1;
+    memset(gfc->sv_qnt.pseudohalf, 0, sizeof(gfc->sv_qnt.pseudohalf));
+
+    /* results of the previous stream */
+    if (cfg->vbr != vbr_off)
+        gfc->ov_enc.bitrate_index = 1;
+    gfc->ov_enc.padding = 0;
+    gfc->ov_enc.mode_ext = 0;
+    gfc->ov_enc.encoder_padding = 0;
+    gfc->ov_rpg.RadioGain = 0;
+    gfc->ov_rpg.noclipGainChange = 0;
+    gfc->ov_rpg.noclipScale = -1.0;
+    gfc->nMusicCRC = 0;
+    gfc->transcode.hip = 0;
+
+    /* keep the ReplayGain state for the next stream, the decoder is
+       created again by the first frame */
+    if (gfc->sv_rpg.rgdata != NULL) {
+        if (InitGainAnalysis(gfc->sv_rpg.rgdata, cfg->samplerate_out) == INIT_GAIN_ANALYSIS_ERROR) {
+            return -6;
+        }
+    }
+#ifdef DECODE_ON_THE_FLY
+    if (gfc->hip) {
+        hip_decode_exit(gfc->hip);
+        gfc->hip = 0;
+    }
+#endif
+
+    return lame_init_bitstream(gfp);
+}
+
+
+int
+lame_get_memory_usage(const lame_global_flags * gfp, lame_memory_usage * usage)
+{
+    lame_internal_flags const *gfc;
+    EncStateVar_t const *esv;
+    size_t  embedded;
+
+    if (!is_lame_global_flags_valid(gfp) || usage == 0)
+        return -3;
+    gfc = gfp->internal_flags;
+    if (gfc == 0)
+        return -3;
+    esv = &gfc->sv_enc;
+    memset(usage, 0, sizeof(*usage));
+
+    /* parts of lame_internal_flags are counted with their subsystem */
+    usage->input = sizeof(esv->sb_sample)
+        + 2 * esv->in_buffer_nsamples * sizeof(sample_t)
+        + fill_buffer_memory_usage(gfc);
+    if (esv->mfbuf[0])
+        usage->input += gfc->cfg.channels_out * MFSIZE * sizeof(sample_t);
+    usage->psymodel = sizeof(gfc->sv_psy) + sizeof(gfc->ov_psy);
+    usage->psymodel += global_data_memory_usage(gfc);
+    if (gfc->ATH)
+        usage->psymodel += sizeof(*gfc->ATH);
+    usage->quantizer = sizeof(gfc->l3_side) + sizeof(gfc->sv_qnt) + sizeof(gfc->scalefac_band);
+    usage->bitstream = sizeof(esv->header) + gfc->bs.buf_size;
+    if (gfc->sv_rpg.rgdata)
+        usage->replaygain = sizeof(*gfc->sv_rpg.rgdata);
+    usage->tags = gfc->VBR_seek_table.size * sizeof(gfc->VBR_seek_table.bag[0])
+        + id3tag_memory_usage(gfc);
+#ifdef DECODE_ON_THE_FLY
+    usage->decoder = hip_memory_usage(gfc->hip);
+#endif
+
+    embedded = sizeof(esv->sb_sample) + sizeof(esv->header)
+        + sizeof(gfc->sv_psy) + sizeof(gfc->ov_psy)
+        + sizeof(gfc->l3_side) + sizeof(gfc->sv_qnt) + sizeof(gfc->scalefac_band);
+    usage->session = sizeof(*gfp) + sizeof(*gfc) - embedded;
+
+    usage->total = usage->session + usage->input + usage->psymodel + usage->quantizer
+        + usage->bitstream + usage->replaygain + usage->tags + usage->decoder;
+    return 0;
+}
+
+
 /*****************************************************************/
 /* flush internal PCM sample buffers, then mp3 buffers           */
 /* then write id3 v1 tags into bitstream.                        */
 /*****************************************************************/
 
-int
-lame_encode_flush(lame_global_flags * gfp, unsigned char *mp3buffer, int mp3buffer_size)
+static int
+encode_flush(lame_global_flags * gfp, unsigned char *mp3buffer, int mp3buffer_size)
 {
     lame_internal_flags *gfc;
     SessionConfig_t const *cfg;
@@ -2133,7 +2565,9 @@ lame_encode_flush(lame_global_flags * gfp, unsigned char *mp3buffer, int mp3buff
         mp3buffer_size_remaining = 0;
 
     /* mp3 related stuff.  bit buffer might still contain some mp3 data */
-    flush_bitstream(gfc);
+    if (flush_bitstream(gfc) < 0) {
+        return -2;
+    }
     imp3 = copy_buffer(gfc, mp3buffer, mp3buffer_size_remaining, 1);
     save_gain_values(gfc);
     if (imp3 < 0) {
@@ -2149,7 +2583,9 @@ lame_encode_flush(lame_global_flags * gfp, unsigned char *mp3buffer, int mp3buff
 
     if (gfp->write_id3tag_automatic) {
         /* write a id3 tag to the bitstream */
-        (void) id3tag_write_v1(gfp);
+        if (id3tag_write_v1(gfp) < 0) {
+            return -2;
+        }
 
         imp3 = copy_buffer(gfc, mp3buffer, mp3buffer_size_remaining, 0);
 
@@ -2176,6 +2612,15 @@ lame_encode_flush(lame_global_flags * gfp, unsigned char *mp3buffer, int mp3buff
     return mp3count;
 }
 
+int
+lame_encode_flush(lame_global_flags * gfp, unsigned char *mp3buffer, int mp3buffer_size)
+{
+    fpu_mode_t const fpu = encoder_fpu_enter(gfp);
+    int const ret = encode_flush(gfp, mp3buffer, mp3buffer_size);
+    encoder_fpu_leave(gfp, fpu);
+    return ret;
+}
+
 /***********************************************************************
  *
  *      lame_close ()
@@ -2313,10 +2758,6 @@ lame_init_internal_flags(lame_internal_flags* gfc)
     if (NULL == gfc->ATH)
         return -2;      /* maybe error codes should be enumerated in lame.h ?? */
 
-    gfc->sv_rpg.rgdata = lame_calloc(replaygain_t, 1);
-    if (NULL == gfc->sv_rpg.rgdata) {
-        return -2;
-    }
     return 0;
 }
 
@@ -2395,6 +2836,7 @@ lame_init_old(lame_global_flags * gfp)
     gfp->preset = 0;
 
     gfp->write_id3tag_automatic = 1;
+    gfp->flush_denormals = 1;
 
     gfp->report.debugf = &lame_report_def;
     gfp->report.errorf = &lame_report_def;
@@ -2434,6 +2876,218 @@ lame_init(void)
 }
 
 
+/***********************************************************************
+ *
+ *  session pool
+ *
+ *  A pool holds sessions initialized with one set of parameters.
+ *  lame_pool_checkout() hands out a free session, lame_pool_checkin()
+ *  resets it with lame_reset() and makes it available again.  Each slot
+ *  has a busy flag which is claimed with an atomic compare-and-swap, so
+ *  threads never block each other.  If all sessions are busy, a new one
+ *  is created on the fly and closed again on checkin.
+ *
+ *  Only the thread holding a slot changes its session pointer, always
+ *  with a compare-and-swap, and it releases the slot with one, so the
+ *  next owner sees the session completely reset.  A slot whose session
+ *  could not be recreated is released with a NULL session and gets a
+ *  new one at its next checkout.
+ *
+ ***********************************************************************/
+
+struct lame_pool_struct {
+    lame_global_flags config; /* settings every session is created from */
+    int     size;
+    lame_t volatile *session;
+    int volatile *busy;
+    int volatile next;       /* where the next checkout starts to look */
+
+    int volatile in_use;
+    int volatile max_in_use;
+    int volatile checkouts;
+    int volatile misses;
+    int volatile checkins;
+    int volatile failures;
+};
+
+
+static lame_t
+lame_pool_new_session(lame_pool_t pool)
+{
+    lame_global_flags *gfp = lame_init();
+    lame_internal_flags *gfc;
+
+    if (gfp == NULL)
+        return NULL;
+    gfc = gfp->internal_flags;
+    *gfp = pool->config;
+    gfp->class_id = LAME_ID;
+    gfp->lame_allocated_gfp = 1;
+    gfp->internal_flags = gfc;
+    /* a pooled session may serve any stream, so tags are up to the caller */
+    gfp->write_id3tag_automatic = 0;
+    if (lame_init_params(gfp) < 0) {
+        lame_close(gfp);
+        return NULL;
+    }
+    return gfp;
+}
+
+
+lame_pool_t
+lame_pool_init(const lame_global_flags * config, int size)
+{
+    lame_pool_t pool;
+    int     i;
+
+    if (!is_lame_global_flags_valid(config) || size < 0)
+        return NULL;
+    pool = lame_calloc(struct lame_pool_struct, 1);
+    if (pool == NULL)
+        return NULL;
+    pool->config = *config;
+    pool->config.internal_flags = NULL;
+    pool->size = size;
+    if (size > 0) {
+        pool->session = lame_calloc(lame_t, size);
+        pool->busy = lame_calloc(int, size);
+        if (pool->session == NULL || pool->busy == NULL) {
+            lame_pool_close(pool);
+            return NULL;
+        }
+    }
+    for (i = 0; i < size; ++i) {
+        pool->session[i] = lame_pool_new_session(pool);
+        if (pool->session[i] == NULL) {
+            lame_pool_close(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+
+lame_t
+lame_pool_checkout(lame_pool_t pool)
+{
+    lame_t  gfp = NULL;
+    int     i, start, in_use, max_in_use;
+
+    if (pool == NULL)
+        return NULL;
+
+    start = pool->next;
+    for (i = 0; i < pool->size; ++i) {
+        int const k = (start + i) % pool->size;
+        if (pool->busy[k] == 0 && LAME_ATOMIC_CAS(&pool->busy[k], 0, 1)) {
+            (void) LAME_ATOMIC_CAS(&pool->next, start, k + 1);
+            gfp = pool->session[k];
+            if (gfp == NULL) {
+                /* the session of this slot could not be recreated at checkin */
+                gfp = lame_pool_new_session(pool);
+                if (gfp == NULL) {
+                    (void) LAME_ATOMIC_CAS(&pool->busy[k], 1, 0);
+                    LAME_ATOMIC_ADD(&pool->failures, 1);
+                    return NULL;
+                }
+                (void) LAME_ATOMIC_CAS_PTR(&pool->session[k], NULL, gfp);
+            }
+            break;
+        }
+    }
+    if (gfp == NULL) {
+        gfp = lame_pool_new_session(pool);
+        if (gfp == NULL) {
+            LAME_ATOMIC_ADD(&pool->failures, 1);
+            return NULL;
+        }
+        LAME_ATOMIC_ADD(&pool->misses, 1);
+    }
+    LAME_ATOMIC_ADD(&pool->checkouts, 1);
+
+    in_use = LAME_ATOMIC_ADD(&pool->in_use, 1) + 1;
+    do {
+        max_in_use = pool->max_in_use;
+    } while (in_use > max_in_use && !LAME_ATOMIC_CAS(&pool->max_in_use, max_in_use, in_use));
+
+    return gfp;
+}
+
+
+int
+lame_pool_checkin(lame_pool_t pool, lame_t gfp)
+{
+    int     i, ret;
+
+    if (pool == NULL || gfp == NULL)
+        return -3;
+
+    LAME_ATOMIC_ADD(&pool->checkins, 1);
+
+    ret = 0;
+    for (i = 0; i < pool->size; ++i) {
+        if (pool->session[i] == gfp) {
+            id3tag_init(gfp);
+            ret = lame_reset(gfp);
+            if (ret < 0) {
+                /* replace the broken session by a fresh one; the slot is
+                 * emptied first, so no other checkin can match the closed one */
+                LAME_ATOMIC_ADD(&pool->failures, 1);
+                (void) LAME_ATOMIC_CAS_PTR(&pool->session[i], gfp, NULL);
+                lame_close(gfp);
+                gfp = lame_pool_new_session(pool);
+                if (gfp != NULL)
+                    (void) LAME_ATOMIC_CAS_PTR(&pool->session[i], NULL, gfp);
+            }
+            (void) LAME_ATOMIC_CAS(&pool->busy[i], 1, 0);
+            break;
+        }
+    }
+    if (i == pool->size) {
+        /* created on the fly by lame_pool_checkout */
+        ret = lame_close(gfp);
+    }
+    LAME_ATOMIC_ADD(&pool->in_use, -1);
+    return ret;
+}
+
+
+int
+lame_pool_get_stats(lame_pool_t pool, lame_pool_stats_t * stats)
+{
+    if (pool == NULL || stats == NULL)
+        return -3;
+    stats->size = pool->size;
+    stats->in_use = pool->in_use;
+    stats->max_in_use = pool->max_in_use;
+    stats->checkouts = pool->checkouts;
+    stats->misses = pool->misses;
+    stats->checkins = pool->checkins;
+    stats->failures = pool->failures;
+    return 0;
+}
+
+
+void
+lame_pool_close(lame_pool_t pool)
+{
+    int     i;
+
+    if (pool == NULL)
+        return;
+    if (pool->session != NULL) {
+        for (i = 0; i < pool->size; ++i) {
+            if (pool->session[i] != NULL)
+                lame_close(pool->session[i]);
+        }
+        free((void *) pool->session);
+    }
+    if (pool->busy != NULL)
+        free((void *) pool->busy);
+    free(pool);
+}
+
+
 /***********************************************************************
  *
  *  some simple statistics
@@ -2489,9 +3143,12 @@ lame_bitrate_hist(const lame_global_flags * gfp, int bitrate_count[14])
         lame_internal_flags const *const gfc = gfp->internal_flags;
         if (is_lame_internal_flags_valid(gfc)) {
             SessionConfig_t const *const cfg = &gfc->cfg;
-            EncResult_t const *const eov = &gfc->ov_enc;
+            EncResult_t eov_snapshot;
+            EncResult_t const *const eov = &eov_snapshot;
             int     i;
 
+            enc_stats_read(&gfc->ov_enc, &eov_snapshot);
+
             if (cfg->free_format) {
                 for (i = 0; i < 14; i++) {
                     bitrate_count[i] = 0;
@@ -2514,9 +3171,12 @@ lame_stereo_mode_hist(const lame_global_flags * gfp, int stmode_count[4])
     if (is_lame_global_flags_valid(gfp)) {
         lame_internal_flags const *const gfc = gfp->internal_flags;
         if (is_lame_internal_flags_valid(gfc)) {
-            EncResult_t const *const eov = &gfc->ov_enc;
+            EncResult_t eov_snapshot;
+            EncResult_t const *const eov = &eov_snapshot;
             int     i;
 
+            enc_stats_read(&gfc->ov_enc, &eov_snapshot);
+
             for (i = 0; i < 4; i++) {
                 stmode_count[i] = eov->bitrate_channelmode_hist[15][i];
             }
@@ -2533,10 +3193,13 @@ lame_bitrate_stereo_mode_hist(const lame_global_flags * gfp, int bitrate_stmode_
         lame_internal_flags const *const gfc = gfp->internal_flags;
         if (is_lame_internal_flags_valid(gfc)) {
             SessionConfig_t const *const cfg = &gfc->cfg;
-            EncResult_t const *const eov = &gfc->ov_enc;
+            EncResult_t eov_snapshot;
+            EncResult_t const *const eov = &eov_snapshot;
             int     i;
             int     j;
 
+            enc_stats_read(&gfc->ov_enc, &eov_snapshot);
+
             if (cfg->free_format) {
                 for (j = 0; j < 14; j++)
                     for (i = 0; i < 4; i++) {
@@ -2564,9 +3227,12 @@ lame_block_type_hist(const lame_global_flags * gfp, int btype_count[6])
     if (is_lame_global_flags_valid(gfp)) {
         lame_internal_flags const *const gfc = gfp->internal_flags;
         if (is_lame_internal_flags_valid(gfc)) {
-            EncResult_t const *const eov = &gfc->ov_enc;
+            EncResult_t eov_snapshot;
+            EncResult_t const *const eov = &eov_snapshot;
             int     i;
 
+            enc_stats_read(&gfc->ov_enc, &eov_snapshot);
+
             for (i = 0; i < 6; ++i) {
                 btype_count[i] = eov->bitrate_blocktype_hist[15][i];
             }
@@ -2583,9 +3249,12 @@ lame_bitrate_block_type_hist(const lame_global_flags * gfp, int bitrate_btype_co
         lame_internal_flags const *const gfc = gfp->internal_flags;
         if (is_lame_internal_flags_valid(gfc)) {
             SessionConfig_t const *const cfg = &gfc->cfg;
-            EncResult_t const *const eov = &gfc->ov_enc;
+            EncResult_t eov_snapshot;
+            EncResult_t const *const eov = &eov_snapshot;
             int     i, j;
 
+            enc_stats_read(&gfc->ov_enc, &eov_snapshot);
+
             if (cfg->free_format) {
                 for (j = 0; j < 14; ++j) {
                     for (i = 0; i < 6; ++i) {
@@ -2607,4 +3276,25 @@ lame_bitrate_block_type_hist(const lame_global_flags * gfp, int bitrate_btype_co
     }
 }
 
+
+
+void
+lame_vbr_recovery_hist(const lame_global_flags * gfp, int recovery_count[5])
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags const *const gfc = gfp->internal_flags;
+        if (is_lame_internal_flags_valid(gfc)) {
+            EncResult_t eov_snapshot;
+            EncResult_t const *const eov = &eov_snapshot;
+            int     i;
+
+            enc_stats_read(&gfc->ov_enc, &eov_snapshot);
+
+            for (i = 0; i < 5; ++i) {
+                recovery_count[i] = eov->vbr_recovery_hist[i];
+            }
+        }
+    }
+}
+
 /* end of lame.c */
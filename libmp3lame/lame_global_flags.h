@@ -54,6 +54,7 @@ struct lame_global_struct {
     int     findReplayGain;  /* find the RG value? default=0       */
     int     decode_on_the_fly; /* decode on the fly? default=0                */
     int     write_id3tag_automatic; /* 1 (default) writes ID3 tags, 0 not */
+    int     flush_denormals; /* FTZ/DAZ during lame_encode_*? default=1  */
 
     int     nogap_total;
     int     nogap_current;
@@ -155,6 +156,11 @@ struct lame_global_struct {
         void    (*errorf) (const char *format, va_list ap);
     } report;
 
+    struct {
+        lame_pcm_source_function func; /* see lame_encode_run() */
+        void   *data;
+    } pcm_source;
+
   /************************************************************************/
     /* internal variables, do not set...                                    */
     /* provided because they may be of use to calling application           */
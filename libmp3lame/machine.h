@@ -52,6 +52,8 @@ char   *strchr(), *strrchr();
 # include <math.h>
 #endif
 #include <limits.h>
+#include <stddef.h>
+#include <time.h>
 
 #include <ctype.h>
 
@@ -156,6 +158,20 @@ typedef double FLOAT8;
 # endif
 #endif
 
+/*
+ * TAKEHIRO_IEEE754_HACK quantizes through double precision magic number
+ * additions, because a float to int cast used to mean reloading the x87
+ * control word. Where float math is done in SSE that cast is a single
+ * instruction, and the plain float quantizer is faster than the double
+ * precision detour while producing the same values (except where a
+ * rounding error moves a coefficient across a quantization threshold).
+ */
+#if defined(TAKEHIRO_IEEE754_HACK) && \
+    (defined(__x86_64__) || defined(_M_X64) || defined(__SSE_MATH__) || \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+# undef TAKEHIRO_IEEE754_HACK
+#endif
+
 /* sample_t must be floating point, at least 32 bits */
 typedef FLOAT sample_t;
 
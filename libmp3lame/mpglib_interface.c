@@ -145,9 +145,13 @@ decode1_headersB_clipchoice(PMPSTR pmp, unsigned char *buffer, size_t len,
     int     i;
     int const len_l = len < INT_MAX ? (int) len : INT_MAX;
     int const psize_l = psize < INT_MAX ? (int) psize : INT_MAX;
+    fpu_mode_t fpu;
 
     mp3data->header_parsed = 0;
+    /* the synthesis filter rings down into denormals after the music stops */
+    fpu = fpu_flush_denormals_enter(1);
     ret = (*decodeMP3_ptr) (pmp, buffer, len_l, p, psize_l, &processed_bytes);
+    fpu_flush_denormals_leave(fpu);
     /* three cases:  
      * 1. headers parsed, but data not complete
      *       pmp->header_parsed==1 
@@ -364,6 +368,12 @@ hip_decode1_unclipped(hip_t hip, unsigned char *buffer, size_t len, sample_t pcm
     return 0;
 }
 
+size_t
+hip_memory_usage(hip_t hip)
+{
+    return hip ? sizeof(*hip) + (size_t) hip->bsize : 0;
+}
+
 /*
  * For hip_decode:  return code
  *  -1     error
@@ -472,6 +482,133 @@ void hip_set_msgf  (hip_t hip, lame_report_function func)
     }
 }
 
+
+
+/*
+ * lame_transcode_buffer: MP3 in, MP3 out.
+ *
+ * Frames are decoded one at a time with the unclipped synthesis, so the
+ * encoder gets the decoder's float output as it is, and each frame is
+ * encoded right away.  The first frame of a stream sets up the delay
+ * compensation: the decoder delay is always dropped, and if the source
+ * has a LAME tag, so are its encoder delay and padding.
+ */
+
+static int
+transcode_start(lame_global_flags * gfp, hip_t hip, mp3data_struct const *mp3data)
+{
+    lame_internal_flags *const gfc = gfp->internal_flags;
+    int const dec_delay = (hip->fr.lay == 3 ? 528 : 240) + 1;
+
+    if (!is_lame_internal_flags_valid(gfc)) {
+        /* lame_init_params() not called yet: take the input format from the stream */
+        lame_set_in_samplerate(gfp, mp3data->samplerate);
+        lame_set_num_channels(gfp, mp3data->stereo);
+        if (hip->num_frames > 0 && hip->enc_delay >= 0 && hip->enc_padding >= 0
+            && lame_get_num_samples(gfp) == MAX_U_32_NUM) {
+            long const n = (long) hip->num_frames * mp3data->framesize
+                - hip->enc_delay - hip->enc_padding;
+            if (n > 0)
+                lame_set_num_samples(gfp, (unsigned long) n);
+        }
+        if (lame_init_params(gfp) < 0)
+            return -3;
+    }
+    else if (gfc->cfg.samplerate_in != mp3data->samplerate
+             || gfc->cfg.channels_in != mp3data->stereo) {
+        return -7;
+    }
+
+    gfc->transcode.hip = hip;
+    gfc->transcode.skip = dec_delay;
+    gfc->transcode.limited = 0;
+    gfc->transcode.remaining = 0;
+    if (hip->enc_delay >= 0) {
+        gfc->transcode.skip += hip->enc_delay;
+        if (hip->num_frames > 0 && hip->enc_padding >= 0) {
+            long const n = (long) hip->num_frames * mp3data->framesize
+                - hip->enc_delay - hip->enc_padding;
+            gfc->transcode.limited = 1;
+            gfc->transcode.remaining = n > 0 ? (unsigned long) n : 0;
+        }
+    }
+    return 0;
+}
+
+
+int
+lame_transcode_buffer(lame_global_flags * gfp, hip_t hip, unsigned char *mp3in, size_t mp3in_size,
+                      unsigned char *mp3buf, int mp3buf_size)
+{
+    char    out[OUTSIZE_UNCLIPPED];
+    sample_t pcm[2][1152];
+    mp3data_struct mp3data;
+    int     enc_delay, enc_padding;
+    int     mp3size = 0;
+    lame_internal_flags *gfc;
+
+    if (!is_lame_global_flags_valid(gfp) || hip == 0 || mp3in_size > INT_MAX)
+        return -3;
+    gfc = gfp->internal_flags;
+    memset(&mp3data, 0, sizeof(mp3data));
+
+    for (;;) {
+        int const bsize = hip->bsize + (int) mp3in_size;
+        int     n, skip, ret;
+
+        /* leave the rest in hip if another frame might not fit */
+        if (mp3buf_size != 0 && mp3size > 0) {
+            SessionConfig_t const *const cfg = &gfc->cfg;
+            int const nout = (int) (((double) 1152 * cfg->samplerate_out + cfg->samplerate_in - 1)
+                                    / cfg->samplerate_in);
+            if (mp3buf_size - mp3size < (5 * nout) / 4 + 7200)
+                break;
+        }
+
+        n = decode1_headersB_clipchoice(hip, mp3in, mp3in_size, (char *) pcm[0], (char *) pcm[1],
+                                        &mp3data, &enc_delay, &enc_padding, out,
+                                        OUTSIZE_UNCLIPPED, sizeof(FLOAT), decodeMP3_unclipped);
+        mp3in = 0;
+        mp3in_size = 0; /* further calls decode what hip has buffered */
+        if (n < 0)
+            return -7;
+        if (n == 0) {
+            /* no samples from the VBR tag frame or after a resync: go on if hip made progress */
+            if (hip->bsize < bsize)
+                continue;
+            break;
+        }
+
+        if (!is_lame_internal_flags_valid(gfc) || gfc->transcode.hip != hip) {
+            ret = transcode_start(gfp, hip, &mp3data);
+            if (ret < 0)
+                return ret;
+        }
+        else if (gfc->cfg.samplerate_in != mp3data.samplerate
+                 || gfc->cfg.channels_in != mp3data.stereo) {
+            return -7;
+        }
+
+        skip = gfc->transcode.skip < n ? gfc->transcode.skip : n;
+        gfc->transcode.skip -= skip;
+        n -= skip;
+        if (gfc->transcode.limited) {
+            if ((unsigned long) n > gfc->transcode.remaining)
+                n = (int) gfc->transcode.remaining;
+            gfc->transcode.remaining -= n;
+        }
+        if (n == 0)
+            continue;
+
+        ret = lame_encode_buffer_float(gfp, pcm[0] + skip, pcm[1] + skip, n, mp3buf + mp3size,
+                                       mp3buf_size == 0 ? 0 : mp3buf_size - mp3size);
+        if (ret < 0)
+            return ret;
+        mp3size += ret;
+    }
+    return mp3size;
+}
+
 #endif
 
 /* end of mpglib_interface.c */
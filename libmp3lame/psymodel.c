@@ -152,6 +152,9 @@ blocktype_d[2]        block type to use for previous granule
 #include "lame_global_flags.h"
 #include "fft.h"
 #include "lame-analysis.h"
+#ifdef HAVE_XMMINTRIN_H
+#include "vector/lame_intrin.h"
+#endif
 
 typedef PsyConst_CB2SB_t const* const PsyConst_CB2SB_Ptr;
 
@@ -805,6 +808,65 @@ vbrpsy_compute_loudness_approximation_l(lame_internal_flags * gfc, int gr_out, i
 }
 
 
+/* high pass filter of fs/4, the symmetric half of a NSFIRLEN tap FIR */
+static const FLOAT fircoef[(NSFIRLEN - 1) / 2] = {
+    -8.65163e-18 * 2, -0.00851586 * 2, -6.74764e-18 * 2, 0.0209036 * 2,
+    -3.36639e-17 * 2, -0.0438162 * 2, -1.54175e-17 * 2, 0.0931738 * 2,
+    -5.52212e-17 * 2, -0.313819 * 2
+};
+
+/*
+ * filter 576 samples of each channel with the fs/4 high pass and return
+ * the peak magnitude (at least 1) of each of the 9 sub-short blocks in
+ * peaks[chn].  With ms != 0 also the peaks of the mid (l+r) and side
+ * (l-r) filtered signals in peaks[2] and peaks[3].
+ */
+static void
+attack_hpf_peaks_c(FLOAT const *coef, const sample_t * const firbuf[2], int n_chn, int ms,
+                   FLOAT peaks[4][9])
+{
+    FLOAT   ns_hpfsmpl[2][576];
+    int const n_chn_psy = ms ? 4 : n_chn;
+    int     chn, i, j;
+
+    /* Don't copy the input buffer into a temporary buffer */
+    /* unroll the loop 2 times */
+    for (chn = 0; chn < n_chn; chn++) {
+        const sample_t *const x = firbuf[chn];
+        for (i = 0; i < 576; i++) {
+            FLOAT   sum1, sum2;
+            sum1 = x[i + 10];
+            sum2 = 0.0;
+            for (j = 0; j < ((NSFIRLEN - 1) / 2) - 1; j += 2) {
+                sum1 += coef[j] * (x[i + j] + x[i + NSFIRLEN - j]);
+                sum2 += coef[j + 1] * (x[i + j + 1] + x[i + NSFIRLEN - j - 1]);
+            }
+            ns_hpfsmpl[chn][i] = sum1 + sum2;
+        }
+    }
+    for (chn = 0; chn < n_chn_psy; chn++) {
+        FLOAT const *pf = ns_hpfsmpl[chn & 1];
+
+        if (chn == 2) {
+            for (i = 0, j = 576; j > 0; ++i, --j) {
+                FLOAT const l = ns_hpfsmpl[0][i];
+                FLOAT const r = ns_hpfsmpl[1][i];
+                ns_hpfsmpl[0][i] = l + r;
+                ns_hpfsmpl[1][i] = l - r;
+            }
+        }
+        for (i = 0; i < 9; i++) {
+            FLOAT const *const pfe = pf + 576 / 9;
+            FLOAT   p = 1.;
+            for (; pf < pfe; pf++)
+                if (p < fabs(*pf))
+                    p = fabs(*pf);
+            peaks[chn][i] = p;
+        }
+    }
+}
+
+
     /**********************************************************************
     *  Apply HPF of fs/4 to the input signal.
     *  This is used for attack detection / handling.
@@ -815,37 +877,25 @@ vbrpsy_attack_detection(lame_internal_flags * gfc, const sample_t * const buffer
                         FLOAT energy[4], FLOAT sub_short_factor[4][3], int ns_attacks[4][4],
                         int uselongblock[2])
 {
-    FLOAT   ns_hpfsmpl[2][576];
+    FLOAT   peaks[4][9];
     SessionConfig_t const *const cfg = &gfc->cfg;
     PsyStateVar_t *const psv = &gfc->sv_psy;
     plotting_data *plt = cfg->analysis ? gfc->pinfo : 0;
     int const n_chn_out = cfg->channels_out;
     /* chn=2 and 3 = Mid and Side channels */
     int const n_chn_psy = (cfg->mode == JOINT_STEREO) ? 4 : n_chn_out;
-    int     chn, i, j;
+    int     chn, i;
 
-    memset(&ns_hpfsmpl[0][0], 0, sizeof(ns_hpfsmpl));
-    /* Don't copy the input buffer into a temporary buffer */
-    /* unroll the loop 2 times */
-    for (chn = 0; chn < n_chn_out; chn++) {
-        static const FLOAT fircoef[] = {
-            -8.65163e-18 * 2, -0.00851586 * 2, -6.74764e-18 * 2, 0.0209036 * 2,
-            -3.36639e-17 * 2, -0.0438162 * 2, -1.54175e-17 * 2, 0.0931738 * 2,
-            -5.52212e-17 * 2, -0.313819 * 2
-        };
+    {
         /* apply high pass filter of fs/4 */
-        const sample_t *const firbuf = &buffer[chn][576 - 350 - NSFIRLEN + 192];
+        const sample_t *firbuf[2];
         assert(dimension_of(fircoef) == ((NSFIRLEN - 1) / 2));
-        for (i = 0; i < 576; i++) {
-            FLOAT   sum1, sum2;
-            sum1 = firbuf[i + 10];
-            sum2 = 0.0;
-            for (j = 0; j < ((NSFIRLEN - 1) / 2) - 1; j += 2) {
-                sum1 += fircoef[j] * (firbuf[i + j] + firbuf[i + NSFIRLEN - j]);
-                sum2 += fircoef[j + 1] * (firbuf[i + j + 1] + firbuf[i + NSFIRLEN - j - 1]);
-            }
-            ns_hpfsmpl[chn][i] = sum1 + sum2;
-        }
+        firbuf[0] = firbuf[1] = &buffer[0][576 - 350 - NSFIRLEN + 192];
+        if (n_chn_out > 1)
+            firbuf[1] = &buffer[1][576 - 350 - NSFIRLEN + 192];
+        gfc->attack_hpf_peaks(fircoef, firbuf, n_chn_out, n_chn_psy > 2, peaks);
+    }
+    for (chn = 0; chn < n_chn_out; chn++) {
         masking_ratio[gr_out][chn].en = psv->en[chn];
         masking_ratio[gr_out][chn].thm = psv->thm[chn];
         if (n_chn_psy > 2) {
@@ -859,17 +909,8 @@ vbrpsy_attack_detection(lame_internal_flags * gfc, const sample_t * const buffer
         FLOAT   attack_intensity[12];
         FLOAT   en_subshort[12];
         FLOAT   en_short[4] = { 0, 0, 0, 0 };
-        FLOAT const *pf = ns_hpfsmpl[chn & 1];
         int     ns_uselongblock = 1;
 
-        if (chn == 2) {
-            for (i = 0, j = 576; j > 0; ++i, --j) {
-                FLOAT const l = ns_hpfsmpl[0][i];
-                FLOAT const r = ns_hpfsmpl[1][i];
-                ns_hpfsmpl[0][i] = l + r;
-                ns_hpfsmpl[1][i] = l - r;
-            }
-        }
         /*************************************************************** 
         * determine the block type (window type)
         ***************************************************************/
@@ -882,11 +923,7 @@ vbrpsy_attack_detection(lame_internal_flags * gfc, const sample_t * const buffer
         }
 
         for (i = 0; i < 9; i++) {
-            FLOAT const *const pfe = pf + 576 / 9;
-            FLOAT   p = 1.;
-            for (; pf < pfe; pf++)
-                if (p < fabs(*pf))
-                    p = fabs(*pf);
+            FLOAT   p = peaks[chn][i];
             psv->last_en_subshort[chn][i] = en_subshort[i + 3] = p;
             en_short[1 + i / 3] += p;
             if (p > en_subshort[i + 3 - 2]) {
@@ -1337,62 +1374,57 @@ vbrpsy_compute_MS_thresholds(const FLOAT eb[4][CBANDS], FLOAT thr[4][CBANDS],
                              FLOAT msfix, int n)
 {
     FLOAT const msfix2 = msfix * 2.f;
-    FLOAT   rside, rmid;
     int     b;
+    /* the bands are independent; selects instead of branches let the
+     * compiler run them in parallel over the eb and thr rows */
     for (b = 0; b < n; ++b) {
         FLOAT const ebM = eb[2][b];
         FLOAT const ebS = eb[3][b];
         FLOAT const thmL = thr[0][b];
         FLOAT const thmR = thr[1][b];
-        FLOAT   thmM = thr[2][b];
-        FLOAT   thmS = thr[3][b];
+        FLOAT const thmM = thr[2][b];
+        FLOAT const thmS = thr[3][b];
 
         /* use this fix if L & R masking differs by 2db or less */
         /* if db = 10*log10(x2/x1) < 2 */
         /* if (x2 < 1.58*x1) { */
-        if (thmL <= 1.58f * thmR && thmR <= 1.58f * thmL) {
-            FLOAT const mld_m = cb_mld[b] * ebS;
-            FLOAT const mld_s = cb_mld[b] * ebM;
-            FLOAT const tmp_m = Min(thmS, mld_m);
-            FLOAT const tmp_s = Min(thmM, mld_s);
-            rmid = Max(thmM, tmp_m);
-            rside = Max(thmS, tmp_s);
-        }
-        else {
-            rmid = thmM;
-            rside = thmS;
-        }
-        if (msfix > 0.f) {
-            /***************************************************************/
-            /* Adjust M/S maskings if user set "msfix"                     */
-            /***************************************************************/
-            /* Naoki Shibata 2000 */
-            FLOAT   thmLR, thmMS;
-            FLOAT const ath = ath_cb[b] * athlower;
-            FLOAT const tmp_l = Max(thmL, ath);
-            FLOAT const tmp_r = Max(thmR, ath);
-            thmLR = Min(tmp_l, tmp_r);
-            thmM = Max(rmid, ath);
-            thmS = Max(rside, ath);
-            thmMS = thmM + thmS;
-            if (thmMS > 0.f && (thmLR * msfix2) < thmMS) {
-                FLOAT const f = thmLR * msfix2 / thmMS;
-                thmM *= f;
-                thmS *= f;
-                assert(thmMS > 0.f);
-            }
-            rmid = Min(thmM, rmid);
-            rside = Min(thmS, rside);
-        }
-        if (rmid > ebM) {
-            rmid = ebM;
-        }
-        if (rside > ebS) {
-            rside = ebS;
-        }
+        int const close = (thmL <= 1.58f * thmR) & (thmR <= 1.58f * thmL);
+        FLOAT const mld_m = cb_mld[b] * ebS;
+        FLOAT const mld_s = cb_mld[b] * ebM;
+        FLOAT const tmp_m = Min(thmS, mld_m);
+        FLOAT const tmp_s = Min(thmM, mld_s);
+        FLOAT const rmid = close ? Max(thmM, tmp_m) : thmM;
+        FLOAT const rside = close ? Max(thmS, tmp_s) : thmS;
         thr[2][b] = rmid;
         thr[3][b] = rside;
     }
+    if (msfix > 0.f) {
+        /***************************************************************/
+        /* Adjust M/S maskings if user set "msfix"                     */
+        /***************************************************************/
+        /* Naoki Shibata 2000 */
+        for (b = 0; b < n; ++b) {
+            FLOAT const rmid = thr[2][b];
+            FLOAT const rside = thr[3][b];
+            FLOAT const ath = ath_cb[b] * athlower;
+            FLOAT const tmp_l = Max(thr[0][b], ath);
+            FLOAT const tmp_r = Max(thr[1][b], ath);
+            FLOAT const thmLR = Min(tmp_l, tmp_r);
+            FLOAT   thmM = Max(rmid, ath);
+            FLOAT   thmS = Max(rside, ath);
+            FLOAT const thmMS = thmM + thmS;
+            int const scale = thmMS > 0.f && (thmLR * msfix2) < thmMS;
+            FLOAT const f = scale ? thmLR * msfix2 / (scale ? thmMS : 1.f) : 1.f;
+            thmM *= f;
+            thmS *= f;
+            thr[2][b] = Min(thmM, rmid);
+            thr[3][b] = Min(thmS, rside);
+        }
+    }
+    for (b = 0; b < n; ++b) {
+        thr[2][b] = Min(thr[2][b], eb[2][b]);
+        thr[3][b] = Min(thr[3][b], eb[3][b]);
+    }
 }
 
 
@@ -1905,35 +1937,15 @@ static int test2(PsyConst_CB2SB_Ptr pcd, int n)
 }
 
 
-int
-psymodel_init(lame_global_flags const *gfp)
+/* set the psymodel state variables to their start-of-stream values */
+void
+psymodel_reset(lame_internal_flags * gfc)
 {
-    lame_internal_flags *const gfc = gfp->internal_flags;
-    SessionConfig_t *const cfg = &gfc->cfg;
     PsyStateVar_t *const psv = &gfc->sv_psy;
-    PsyConst_t *gd;
-    int     i, j, b, sb, k;
-    FLOAT   bvl_a = 13, bvl_b = 24;
-    FLOAT   snr_l_a = 0, snr_l_b = 0;
-    FLOAT   snr_s_a = -8.25, snr_s_b = -4.5;
-
-    FLOAT   bval[CBANDS];
-    FLOAT   bval_width[CBANDS];
-    FLOAT   norm[CBANDS];
-    FLOAT const sfreq = cfg->samplerate_out;
-
-    FLOAT   xav = 10, xbv = 12;
-    FLOAT const minval_low = (0.f - cfg->minval);
-
-    if (gfc->cd_psy != 0) {
-        return 0;
-    }
-    memset(norm, 0, sizeof(norm));
+    int     i, j, sb;
 
-    gd = lame_calloc(PsyConst_t, 1);
-    gfc->cd_psy = gd;
-
-    gd->force_short_block_calc = gfp->experimentalZ;
+    memset(psv, 0, sizeof(*psv));
+    memset(&gfc->ov_psy, 0, sizeof(gfc->ov_psy));
 
     psv->blocktype_old[0] = psv->blocktype_old[1] = NORM_TYPE; /* the vbr header is long blocks */
 
@@ -1962,6 +1974,53 @@ psymodel_init(lame_global_flags const *gfp)
     /* init. for loudness approx. -jd 2001 mar 27 */
     psv->loudness_sq_save[0] = psv->loudness_sq_save[1] = 0.0;
 
+    /* ATH auto adjustment */
+    gfc->ATH->adjust_factor = 0.01; /* minimum, for leading low loudness */
+    gfc->ATH->adjust_limit = 1.0; /* on lead, allow adjust up to maximum */
+}
+
+
+int
+psymodel_init(lame_global_flags const *gfp)
+{
+    lame_internal_flags *const gfc = gfp->internal_flags;
+    SessionConfig_t *const cfg = &gfc->cfg;
+    PsyConst_t *gd;
+    int     i, j, b, k;
+    FLOAT   bvl_a = 13, bvl_b = 24;
+    FLOAT   snr_l_a = 0, snr_l_b = 0;
+    FLOAT   snr_s_a = -8.25, snr_s_b = -4.5;
+
+    FLOAT   bval[CBANDS];
+    FLOAT   bval_width[CBANDS];
+    FLOAT   norm[CBANDS];
+    FLOAT const sfreq = cfg->samplerate_out;
+
+    FLOAT   xav = 10, xbv = 12;
+    FLOAT const minval_low = (0.f - cfg->minval);
+
+    /* gcc and clang vectorize the C filter at -O3 and beat the SSE kernel
+     * there, so it is only used with other compilers, e.g. MSVC */
+    gfc->attack_hpf_peaks = attack_hpf_peaks_c;
+#if defined(HAVE_XMMINTRIN_H) && !defined(__GNUC__)
+    if (gfc->CPU_features.SSE)
+        gfc->attack_hpf_peaks = attack_hpf_peaks_sse;
+#ifdef MIN_ARCH_SSE
+    gfc->attack_hpf_peaks = attack_hpf_peaks_sse;
+#endif
+#endif
+
+    if (gfc->cd_psy != 0) {
+        return 0;
+    }
+    memset(norm, 0, sizeof(norm));
+
+    gd = lame_calloc(PsyConst_t, 1);
+    gfc->cd_psy = gd;
+
+    gd->force_short_block_calc = gfp->experimentalZ;
+
+    psymodel_reset(gfc);
 
 
     /*************************************************************************
@@ -2113,8 +2172,6 @@ psymodel_init(lame_global_flags const *gfp)
      */
 #define  frame_duration (576. * cfg->mode_gr / sfreq)
     gfc->ATH->decay = pow(10., -12. / 10. * frame_duration);
-    gfc->ATH->adjust_factor = 0.01; /* minimum, for leading low loudness */
-    gfc->ATH->adjust_limit = 1.0; /* on lead, allow adjust up to maximum */
 #undef  frame_duration
 
     assert(gd->l.bo[SBMAX_l - 1] <= gd->l.npart);
@@ -227,7 +227,7 @@ static void
 init_outer_loop(lame_internal_flags const *gfc, gr_info * const cod_info)
 {
     SessionConfig_t const *const cfg = &gfc->cfg;
-    int     sfb, j;
+    int     sfb;
     /*  initialize fresh cod_info
      */
     cod_info->part2_3_length = 0;
@@ -262,11 +262,8 @@ init_outer_loop(lame_internal_flags const *gfc, gr_info * const cod_info)
     cod_info->psymax = cod_info->psy_lmax;
     cod_info->sfbmax = cod_info->sfb_lmax;
     cod_info->sfbdivide = 11;
-    for (sfb = 0; sfb < SBMAX_l; sfb++) {
-        cod_info->width[sfb]
-            = gfc->scalefac_band.l[sfb + 1] - gfc->scalefac_band.l[sfb];
-        cod_info->window[sfb] = 3; /* which is always 0. */
-    }
+    cod_info->width = gfc->sv_qnt.sfb_width[0];
+    cod_info->window = gfc->sv_qnt.sfb_window[0];
     if (cod_info->block_type == SHORT_TYPE) {
         FLOAT   ixwork[576];
         FLOAT  *ix;
@@ -281,6 +278,8 @@ init_outer_loop(lame_internal_flags const *gfc, gr_info * const cod_info)
             cod_info->sfb_smin = 3;
             cod_info->sfb_lmax = cfg->mode_gr * 2 + 4;
         }
+        cod_info->width = gfc->sv_qnt.sfb_width[cod_info->mixed_block_flag ? 2 : 1];
+        cod_info->window = gfc->sv_qnt.sfb_window[cod_info->mixed_block_flag ? 2 : 1];
         if (cfg->samplerate_out <= 8000) {
             cod_info->psymax
                 = cod_info->sfb_lmax
@@ -316,15 +315,6 @@ init_outer_loop(lame_internal_flags const *gfc, gr_info * const cod_info)
             }
         }
 
-        j = cod_info->sfb_lmax;
-        for (sfb = cod_info->sfb_smin; sfb < SBMAX_s; sfb++) {
-            cod_info->width[j] = cod_info->width[j + 1] = cod_info->width[j + 2]
-                = gfc->scalefac_band.s[sfb + 1] - gfc->scalefac_band.s[sfb];
-            cod_info->window[j] = 0;
-            cod_info->window[j + 1] = 1;
-            cod_info->window[j + 2] = 2;
-            j += 3;
-        }
     }
 
     cod_info->count1bits = 0;
@@ -1098,10 +1088,12 @@ outer_loop(lame_internal_flags * gfc, gr_info * const cod_info, const FLOAT * co
             if (huff_bits <= 0)
                 break;
 
-            /*  increase quantizer stepsize until needed bits are below maximum
+            /*  increase quantizer stepsize until needed bits are below maximum,
+             *  counting stops as soon as a step is known to need too many bits
              */
             while ((cod_info_w.part2_3_length
-                    = count_bits(gfc, xrpow, &cod_info_w, &prev_noise)) > huff_bits
+                    = count_bits_budget(gfc, xrpow, &cod_info_w, &prev_noise,
+                                        huff_bits)) > huff_bits
                    && cod_info_w.global_gain <= maxggain)
                 cod_info_w.global_gain++;
 
@@ -1110,10 +1102,16 @@ outer_loop(lame_internal_flags * gfc, gr_info * const cod_info, const FLOAT * co
 
             if (best_noise_info.over_count == 0) {
 
-                while ((cod_info_w.part2_3_length
-                        = count_bits(gfc, xrpow, &cod_info_w, &prev_noise)) > best_part2_3_length
-                       && cod_info_w.global_gain <= maxggain)
+                /* part2_3_length at this global_gain is known already,
+                 * counting it again gives the same result
+                 */
+                while (cod_info_w.part2_3_length > best_part2_3_length
+                       && cod_info_w.global_gain <= maxggain) {
                     cod_info_w.global_gain++;
+                    cod_info_w.part2_3_length
+                        = count_bits_budget(gfc, xrpow, &cod_info_w, &prev_noise,
+                                            best_part2_3_length);
+                }
 
                 if (cod_info_w.global_gain > maxggain)
                     break;
@@ -1138,7 +1136,7 @@ outer_loop(lame_internal_flags * gfc, gr_info * const cod_info, const FLOAT * co
             if (better) {
                 best_part2_3_length = cod_info->part2_3_length;
                 best_noise_info = noise_info;
-                *cod_info = cod_info_w;
+                memcpy(cod_info, &cod_info_w, GR_INFO_STATE_SIZE);
                 age = 0;
                 /* save data so we can restore this quantization later */
                 /*if (cfg->vbr == vbr_rh || cfg->vbr == vbr_mtrh) */  {
@@ -1164,7 +1162,7 @@ outer_loop(lame_internal_flags * gfc, gr_info * const cod_info, const FLOAT * co
         if (cfg->noise_shaping_amp == 3) {
             if (!bRefine) {
                 /* refine search */
-                cod_info_w = *cod_info;
+                memcpy(&cod_info_w, cod_info, GR_INFO_STATE_SIZE);
                 memcpy(xrpow, save_xrpow, sizeof(FLOAT) * 576);
                 age = 0;
                 best_ggain_pass1 = cod_info_w.global_gain;
@@ -1283,7 +1281,7 @@ VBR_encode_granule(lame_internal_flags * gfc, gr_info * const cod_info, const FL
 
             /*  store best quantization so far
              */
-            bst_cod_info = *cod_info;
+            memcpy(&bst_cod_info, cod_info, GR_INFO_STATE_SIZE);
             memcpy(bst_xrpow, xrpow, sizeof(FLOAT) * 576);
 
             /*  try with fewer bits
@@ -1303,7 +1301,7 @@ VBR_encode_granule(lame_internal_flags * gfc, gr_info * const cod_info, const FL
                 found = 2;
                 /*  start again with best quantization so far
                  */
-                *cod_info = bst_cod_info;
+                memcpy(cod_info, &bst_cod_info, GR_INFO_STATE_SIZE);
                 memcpy(xrpow, bst_xrpow, sizeof(FLOAT) * 576);
             }
         }
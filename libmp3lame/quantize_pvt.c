@@ -171,7 +171,7 @@ const scalefac_struct sfBandIndex[9] = {
 FLOAT   pow20[Q_MAX + Q_MAX2 + 1];
 FLOAT   ipow20[Q_MAX];
 FLOAT   pow43[PRECALC_SIZE];
-/* initialized in first call to iteration_init */
+/* initialized once per process, in the first call to iteration_init */
 #ifdef TAKEHIRO_IEEE754_HACK
 FLOAT   adj43asm[PRECALC_SIZE];
 #else
@@ -330,9 +330,82 @@ static float const payload_short[2][4] =
 , {-2.000f, -1.000f, -0.050f, +0.500f}
 };
 
+/************************************************************************/
+/*  power tables shared by all encoder instances                        */
+/************************************************************************/
+static void
+init_pow_tables(void)
+{
+    static int volatile init = 0;
+    int     i;
+
+    /* the tables do not depend on the session config,
+     * so they are computed only once per process
+     */
+    if (!lame_once_begin(&init))
+        return;
+
+    pow43[0] = 0.0;
+    for (i = 1; i < PRECALC_SIZE; i++)
+        pow43[i] = pow((FLOAT) i, 4.0 / 3.0);
+
+#ifdef TAKEHIRO_IEEE754_HACK
+    adj43asm[0] = 0.0;
+    for (i = 1; i < PRECALC_SIZE; i++)
+        adj43asm[i] = i - 0.5 - pow(0.5 * (pow43[i - 1] + pow43[i]), 0.75);
+#else
+    for (i = 0; i < PRECALC_SIZE - 1; i++)
+        adj43[i] = (i + 1) - pow(0.5 * (pow43[i] + pow43[i + 1]), 0.75);
+    adj43[i] = 0.5;
+#endif
+    for (i = 0; i < Q_MAX; i++)
+        ipow20[i] = pow(2.0, (double) (i - 210) * -0.1875);
+    for (i = 0; i <= Q_MAX + Q_MAX2; i++)
+        pow20[i] = pow(2.0, (double) (i - 210 - Q_MAX2) * 0.25);
+
+    lame_once_end(&init);
+}
+
+
 /************************************************************************/
 /*  initialization for iteration_loop */
 /************************************************************************/
+/* gr_info width[] and window[] only depend on the block type */
+static void
+init_sfb_layout(lame_internal_flags * gfc)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    QntStateVar_t *const sv_qnt = &gfc->sv_qnt;
+    int     k, sfb, j;
+
+    for (k = 0; k < 3; ++k) {
+        int *const width = sv_qnt->sfb_width[k];
+        int *const window = sv_qnt->sfb_window[k];
+        int     sfb_lmax = 0, sfb_smin = 0;
+
+        for (sfb = 0; sfb < SBMAX_l; sfb++) {
+            width[sfb] = gfc->scalefac_band.l[sfb + 1] - gfc->scalefac_band.l[sfb];
+            window[sfb] = 3; /* which is always 0. */
+        }
+        if (k == 0)
+            continue;   /* long blocks */
+        if (k == 2) {
+            /* mixed blocks, see init_outer_loop */
+            sfb_smin = 3;
+            sfb_lmax = cfg->mode_gr * 2 + 4;
+        }
+        j = sfb_lmax;
+        for (sfb = sfb_smin; sfb < SBMAX_s; sfb++) {
+            width[j] = width[j + 1] = width[j + 2]
+                = gfc->scalefac_band.s[sfb + 1] - gfc->scalefac_band.s[sfb];
+            window[j] = 0;
+            window[j + 1] = 1;
+            window[j + 2] = 2;
+            j += 3;
+        }
+    }
+}
+
 void
 iteration_init(lame_internal_flags * gfc)
 {
@@ -347,26 +420,11 @@ iteration_init(lame_internal_flags * gfc)
         l3_side->main_data_begin = 0;
         compute_ath(gfc);
 
-        pow43[0] = 0.0;
-        for (i = 1; i < PRECALC_SIZE; i++)
-            pow43[i] = pow((FLOAT) i, 4.0 / 3.0);
-
-#ifdef TAKEHIRO_IEEE754_HACK
-        adj43asm[0] = 0.0;
-        for (i = 1; i < PRECALC_SIZE; i++)
-            adj43asm[i] = i - 0.5 - pow(0.5 * (pow43[i - 1] + pow43[i]), 0.75);
-#else
-        for (i = 0; i < PRECALC_SIZE - 1; i++)
-            adj43[i] = (i + 1) - pow(0.5 * (pow43[i] + pow43[i + 1]), 0.75);
-        adj43[i] = 0.5;
-#endif
-        for (i = 0; i < Q_MAX; i++)
-            ipow20[i] = pow(2.0, (double) (i - 210) * -0.1875);
-        for (i = 0; i <= Q_MAX + Q_MAX2; i++)
-            pow20[i] = pow(2.0, (double) (i - 210 - Q_MAX2) * 0.25);
+        init_pow_tables();
 
         huffman_init(gfc);
         init_xrpow_core_init(gfc);
+        init_sfb_layout(gfc);
 
         sel = 1;/* RH: all modes like vbr-new (cfg->vbr == vbr_mt || cfg->vbr == vbr_mtrh) ? 1 : 0;*/
 
@@ -106,6 +106,8 @@ void    set_frame_pinfo(lame_internal_flags * gfc, const III_psy_ratio ratio[2][
 
 int     count_bits(lame_internal_flags const *const gfc, const FLOAT * const xr,
                    gr_info * const cod_info, calc_noise_data * prev_noise);
+int     count_bits_budget(lame_internal_flags const *const gfc, const FLOAT * const xr,
+                          gr_info * const cod_info, calc_noise_data * prev_noise, int budget);
 int     noquant_count_bits(lame_internal_flags const *const gfc,
                            gr_info * const cod_info, calc_noise_data * prev_noise);
 
@@ -556,6 +556,31 @@ lame_get_decode_on_the_fly(const lame_global_flags * gfp)
     return 0;
 }
 
+
+/* flush denormals to zero while encoding */
+int
+lame_set_flush_denormals(lame_global_flags * gfp, int flush_denormals)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        /* default = 1 (enabled) */
+        if (0 > flush_denormals || 1 < flush_denormals)
+            return -1;
+        gfp->flush_denormals = flush_denormals;
+        return 0;
+    }
+    return -1;
+}
+
+int
+lame_get_flush_denormals(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        assert(0 <= gfp->flush_denormals && 1 >= gfp->flush_denormals);
+        return gfp->flush_denormals;
+    }
+    return 0;
+}
+
 #if DEPRECATED_OR_OBSOLETE_CODE_REMOVED
 /* DEPRECATED: now does the same as lame_set_findReplayGain()
    default = 0 (disabled) */
@@ -2020,7 +2045,9 @@ lame_get_frameNum(const lame_global_flags * gfp)
     if (is_lame_global_flags_valid(gfp)) {
         lame_internal_flags const *const gfc = gfp->internal_flags;
         if (is_lame_internal_flags_valid(gfc)) {
-            return gfc->ov_enc.frame_number;
+            EncResult_t eov_snapshot;
+            enc_stats_read(&gfc->ov_enc, &eov_snapshot);
+            return eov_snapshot.frame_number;
         }
     }
     return 0;
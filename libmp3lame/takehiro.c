@@ -210,9 +210,10 @@ quantize_lines_xrpow(unsigned int l, FLOAT istep, const FLOAT * xp, int *pi)
  * if XRPOW_FTOI(x) = floor(x), then QUANTFAC(x)=asj43[x]   
  *                                   ROUNDFAC=0.4054
  *
- * Note: using floor() or (int) is extremely slow. On machines where
- * the TAKEHIRO_IEEE754_HACK code above does not work, it is worthwile
- * to write some ASM for XRPOW_FTOI().  
+ * Note: using floor() or (int) is extremely slow on the x87. On machines
+ * where the TAKEHIRO_IEEE754_HACK code above does not work, it is worthwile
+ * to write some ASM for XRPOW_FTOI(). With SSE math (int) is cheap and
+ * this is the faster version, see machine.h.
  *********************************************************************/
 #define XRPOW_FTOI(src,dest) ((dest) = (int)(src))
 #define QUANTFAC(rx)  adj43[rx]
@@ -651,9 +652,30 @@ choose_table_nonMMX(const int *ix, const int *const end, int *const _s)
 /*************************************************************************/
 /*	      count_bit							 */
 /*************************************************************************/
-int
-noquant_count_bits(lame_internal_flags const *const gfc,
-                   gr_info * const gi, calc_noise_data * prev_noise)
+inline static void
+set_sfb_count1(lame_internal_flags const *const gfc, gr_info const *const gi,
+               calc_noise_data * prev_noise)
+{
+    if (prev_noise) {
+        if (gi->block_type == NORM_TYPE) {
+            int     sfb = 0;
+            while (gfc->scalefac_band.l[sfb] < gi->big_values) {
+                sfb++;
+            }
+            prev_noise->sfb_count1 = sfb;
+        }
+    }
+}
+
+/*
+ * budget: the caller is only interested in counts up to 'budget' bits.
+ * Once the running total is above it, counting stops and LARGE_BITS is
+ * returned; gi->table_select and friends are then left incomplete.
+ * Not used with use_best_huffman == 2, which may still lower the count.
+ */
+inline static int
+noquant_count_bits_budget(lame_internal_flags const *const gfc,
+                          gr_info * const gi, calc_noise_data * prev_noise, int budget)
 {
     SessionConfig_t const *const cfg = &gfc->cfg;
     int     bits = 0;
@@ -700,6 +722,11 @@ noquant_count_bits(lame_internal_flags const *const gfc,
     if (i == 0)
         return bits;
 
+    /* the next quantization depends on sfb_count1, set it before any abort */
+    set_sfb_count1(gfc, gi, prev_noise);
+    if (bits > budget)
+        return LARGE_BITS;
+
     if (gi->block_type == SHORT_TYPE) {
         a1 = 3 * gfc->scalefac_band.s[3];
         if (a1 > gi->big_values)
@@ -715,8 +742,11 @@ noquant_count_bits(lame_internal_flags const *const gfc,
         assert(a1 + a2 + 2 < SBPSY_l);
         a2 = gfc->scalefac_band.l[a1 + a2 + 2];
         a1 = gfc->scalefac_band.l[a1 + 1];
-        if (a2 < i)
+        if (a2 < i) {
             gi->table_select[2] = gfc->choose_table(ix + a2, ix + i, &bits);
+            if (bits > budget)
+                return LARGE_BITS;
+        }
 
     }
     else {
@@ -740,33 +770,35 @@ noquant_count_bits(lame_internal_flags const *const gfc,
     assert(a2 >= 0);
 
     /* Count the number of bits necessary to code the bigvalues region. */
-    if (0 < a1)
+    if (0 < a1) {
         gi->table_select[0] = gfc->choose_table(ix, ix + a1, &bits);
+        if (bits > budget)
+            return LARGE_BITS;
+    }
     if (a1 < a2)
         gi->table_select[1] = gfc->choose_table(ix + a1, ix + a2, &bits);
     if (cfg->use_best_huffman == 2) {
         gi->part2_3_length = bits;
         best_huffman_divide(gfc, gi);
         bits = gi->part2_3_length;
-    }
-
-
-    if (prev_noise) {
-        if (gi->block_type == NORM_TYPE) {
-            int     sfb = 0;
-            while (gfc->scalefac_band.l[sfb] < gi->big_values) {
-                sfb++;
-            }
-            prev_noise->sfb_count1 = sfb;
-        }
+        /* big_values may have changed */
+        set_sfb_count1(gfc, gi, prev_noise);
     }
 
     return bits;
 }
 
 int
-count_bits(lame_internal_flags const *const gfc,
-           const FLOAT * const xr, gr_info * const gi, calc_noise_data * prev_noise)
+noquant_count_bits(lame_internal_flags const *const gfc,
+                   gr_info * const gi, calc_noise_data * prev_noise)
+{
+    return noquant_count_bits_budget(gfc, gi, prev_noise, LARGE_BITS);
+}
+
+int
+count_bits_budget(lame_internal_flags const *const gfc,
+                  const FLOAT * const xr, gr_info * const gi, calc_noise_data * prev_noise,
+                  int budget)
 {
     int    *const ix = gi->l3_enc;
 
@@ -797,7 +829,16 @@ count_bits(lame_internal_flags const *const gfc,
             }
         }
     }
-    return noquant_count_bits(gfc, gi, prev_noise);
+    if (gfc->cfg.use_best_huffman == 2)
+        budget = LARGE_BITS;
+    return noquant_count_bits_budget(gfc, gi, prev_noise, budget);
+}
+
+int
+count_bits(lame_internal_flags const *const gfc,
+           const FLOAT * const xr, gr_info * const gi, calc_noise_data * prev_noise)
+{
+    return count_bits_budget(gfc, xr, gi, prev_noise, LARGE_BITS);
 }
 
 /***********************************************************************
@@ -868,7 +909,7 @@ recalc_divide_sub(const lame_internal_flags * const gfc,
         if (gi->part2_3_length <= bits)
             continue;
 
-        memcpy(gi, cod_info2, sizeof(gr_info));
+        memcpy(gi, cod_info2, GR_INFO_SIDE_SIZE);
         gi->part2_3_length = bits;
         gi->region0_count = r01_div[r2 - 2];
         gi->region1_count = r2 - 2 - r01_div[r2 - 2];
@@ -900,7 +941,7 @@ best_huffman_divide(const lame_internal_flags * const gfc, gr_info * const gi)
         return;
 
 
-    memcpy(&cod_info2, gi, sizeof(gr_info));
+    memcpy(&cod_info2, gi, GR_INFO_SIDE_SIZE);
     if (gi->block_type == NORM_TYPE) {
         recalc_divide_init(gfc, gi, ix, r01_bits, r01_div, r0_tbl, r1_tbl);
         recalc_divide_sub(gfc, &cod_info2, gi, ix, r01_bits, r01_div, r0_tbl, r1_tbl);
@@ -915,7 +956,7 @@ best_huffman_divide(const lame_internal_flags * const gfc, gr_info * const gi)
         return;
 
     /* Determines the number of bits to encode the quadruples. */
-    memcpy(&cod_info2, gi, sizeof(gr_info));
+    memcpy(&cod_info2, gi, GR_INFO_SIDE_SIZE);
     cod_info2.count1 = i;
     a1 = a2 = 0;
 
@@ -952,31 +993,44 @@ best_huffman_divide(const lame_internal_flags * const gfc, gr_info * const gi)
             cod_info2.table_select[1] =
                 gfc->choose_table(ix + a1, ix + i, (int *) &cod_info2.part2_3_length);
         if (gi->part2_3_length > cod_info2.part2_3_length)
-            memcpy(gi, &cod_info2, sizeof(gr_info));
+            memcpy(gi, &cod_info2, GR_INFO_SIDE_SIZE);
     }
 }
 
-static const int slen1_n[16] = { 1, 1, 1, 1, 8, 2, 2, 2, 4, 4, 4, 8, 8, 8, 16, 16 };
-static const int slen2_n[16] = { 1, 2, 4, 8, 1, 2, 4, 8, 2, 4, 8, 2, 4, 8, 4, 8 };
 const int slen1_tab[16] = { 0, 0, 0, 0, 3, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4 };
 const int slen2_tab[16] = { 0, 1, 2, 3, 0, 1, 2, 3, 1, 2, 3, 1, 2, 3, 2, 3 };
 
+/* bits needed for a scalefactor value below 16 */
+static const int log2tab[16] = { 0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+
+/* scalefac_compress values whose slen1 and slen2 can hold
+   log2tab[max_slen1] and log2tab[max_slen2] bits, one bit per index */
+static const unsigned short slen_fits[5][4] = {
+    {0xffff, 0xffee, 0xf6cc, 0xa488},
+    {0xfff0, 0xffe0, 0xf6c0, 0xa480},
+    {0xff10, 0xff00, 0xf600, 0xa400},
+    {0xf810, 0xf800, 0xf000, 0xa000},
+    {0xc000, 0xc000, 0xc000, 0x8000}
+};
+
 static void
 scfsi_calc(int ch, III_side_info_t * l3_side)
 {
-    unsigned int i;
+    unsigned int i, differ = 0;
     int     s1, s2, c1, c2;
     int     sfb;
     gr_info *const gi = &l3_side->tt[1][ch];
     gr_info const *const g0 = &l3_side->tt[0][ch];
 
+    /* one pass over both granules: bit sfb is set where granule 1
+       needs its own scalefactor */
+    for (sfb = 0; sfb < SBPSY_l; sfb++)
+        differ |= (unsigned int) (g0->scalefac[sfb] != gi->scalefac[sfb]
+                                  && gi->scalefac[sfb] >= 0) << sfb;
+
     for (i = 0; i < (sizeof(scfsi_band) / sizeof(int)) - 1; i++) {
-        for (sfb = scfsi_band[i]; sfb < scfsi_band[i + 1]; sfb++) {
-            if (g0->scalefac[sfb] != gi->scalefac[sfb]
-                && gi->scalefac[sfb] >= 0)
-                break;
-        }
-        if (sfb == scfsi_band[i + 1]) {
+        unsigned int const band = (1u << scfsi_band[i + 1]) - (1u << scfsi_band[i]);
+        if ((differ & band) == 0) {
             for (sfb = scfsi_band[i]; sfb < scfsi_band[i + 1]; sfb++) {
                 gi->scalefac[sfb] = -1;
             }
@@ -1002,12 +1056,15 @@ scfsi_calc(int ch, III_side_info_t * l3_side)
             s2 = gi->scalefac[sfb];
     }
 
-    for (i = 0; i < 16; i++) {
-        if (s1 < slen1_n[i] && s2 < slen2_n[i]) {
-            int const c = slen1_tab[i] * c1 + slen2_tab[i] * c2;
-            if (gi->part2_length > c) {
-                gi->part2_length = c;
-                gi->scalefac_compress = (int)i;
+    if (s1 < 16 && s2 < 8) {
+        unsigned int const fits = slen_fits[log2tab[s1]][log2tab[s2]];
+        for (i = 0; i < 16; i++) {
+            if (fits & (1u << i)) {
+                int const c = slen1_tab[i] * c1 + slen2_tab[i] * c2;
+                if (gi->part2_length > c) {
+                    gi->part2_length = c;
+                    gi->scalefac_compress = (int)i;
+                }
             }
         }
     }
@@ -1125,6 +1182,13 @@ static const int scale_long[16] = {
     0, 10, 20, 30, 33, 21, 31, 41, 32, 42, 52, 43, 53, 63, 64, 74
 };
 
+/* the first scalefac_compress with the fewest bits among slen_fits[][],
+   for short and mixed blocks (scale_short, scale_mixed) and long blocks */
+static const unsigned char scale_cheapest[2][5][4] = {
+    {{0, 1, 2, 3}, {5, 5, 6, 7}, {4, 8, 9, 10}, {4, 11, 12, 13}, {14, 14, 14, 15}},
+    {{0, 1, 2, 3}, {5, 5, 6, 7}, {8, 8, 9, 10}, {4, 11, 12, 13}, {14, 14, 14, 15}}
+};
+
 
 /*************************************************************************/
 /*            scale_bitcount                                             */
@@ -1135,7 +1199,7 @@ static const int scale_long[16] = {
 static int
 mpeg1_scale_bitcount(const lame_internal_flags * gfc, gr_info * const cod_info)
 {
-    int     k, sfb, max_slen1 = 0, max_slen2 = 0;
+    int     sfb, max_slen1 = 0, max_slen2 = 0;
 
     /* maximum values */
     const int *tab;
@@ -1173,16 +1237,14 @@ mpeg1_scale_bitcount(const lame_internal_flags * gfc, gr_info * const cod_info)
             max_slen2 = scalefac[sfb];
 
     /* from Takehiro TOMINAGA <tominaga@isoternet.org> 10/99
-     * loop over *all* posible values of scalefac_compress to find the
-     * one which uses the smallest number of bits.  ISO would stop
-     * at first valid index */
+     * use the value of scalefac_compress which needs the smallest number
+     * of bits, not the first valid one as ISO would.  scale_cheapest[]
+     * holds the result of searching all 16 for each pair of slen sizes */
     cod_info->part2_length = LARGE_BITS;
-    for (k = 0; k < 16; k++) {
-        if (max_slen1 < slen1_n[k] && max_slen2 < slen2_n[k]
-            && cod_info->part2_length > tab[k]) {
-            cod_info->part2_length = tab[k];
-            cod_info->scalefac_compress = k;
-        }
+    if (max_slen1 < 16 && max_slen2 < 8) {
+        int const k = scale_cheapest[tab == scale_long][log2tab[max_slen1]][log2tab[max_slen2]];
+        cod_info->part2_length = tab[k];
+        cod_info->scalefac_compress = k;
     }
     return cod_info->part2_length == LARGE_BITS;
 }
@@ -1265,8 +1327,6 @@ mpeg2_scale_bitcount(const lame_internal_flags * gfc, gr_info * const cod_info)
            Since no bands have been over-amplified, we can set scalefac_compress
            and slen[] for the formatter
          */
-        static const int log2tab[] = { 0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
-
         int     slen1, slen2, slen3, slen4;
 
         cod_info->sfb_partition_table = nr_of_sfb_block[table_number][row_in_table];
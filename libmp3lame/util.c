@@ -37,6 +37,15 @@
 # include <machine/floatingpoint.h>
 #endif
 
+/* MXCSR only governs the float math when the compiler does it in SSE */
+#if defined(HAVE_XMMINTRIN_H) && \
+    (defined(__x86_64__) || defined(_M_X64) || defined(__SSE_MATH__))
+# include <xmmintrin.h>
+# define HAVE_MXCSR_DENORMAL_CONTROL
+# define MXCSR_FTZ 0x8000u     /* flush denormal results to zero */
+# define MXCSR_DAZ 0x0040u     /* treat denormal operands as zero */
+#endif
+
 
 /***********************************************************************
 *
@@ -87,6 +96,30 @@ free_id3tag(lame_internal_flags * const gfc)
     }
 }
 
+/* bytes held by the ID3 tag data, see lame_get_memory_usage() */
+size_t
+id3tag_memory_usage(lame_internal_flags const *gfc)
+{
+    id3tag_spec const *const tag = &gfc->tag_spec;
+    FrameDataNode const *node;
+    size_t  bytes = tag->albumart_size;
+
+    if (tag->title)
+        bytes += strlen(tag->title) + 1;
+    if (tag->artist)
+        bytes += strlen(tag->artist) + 1;
+    if (tag->album)
+        bytes += strlen(tag->album) + 1;
+    if (tag->comment)
+        bytes += strlen(tag->comment) + 1;
+    for (node = tag->v2_head; node != 0; node = node->nxt) {
+        bytes += sizeof(*node);
+        bytes += (node->dsc.dim + 1) * (node->dsc.enc == 1 ? 2 : 1);
+        bytes += (node->txt.dim + 1) * (node->txt.enc == 1 ? 2 : 1);
+    }
+    return bytes;
+}
+
 
 static void
 free_global_data(lame_internal_flags * gfc)
@@ -106,6 +139,27 @@ free_global_data(lame_internal_flags * gfc)
 }
 
 
+/* bytes held by cd_psy, see lame_get_memory_usage() */
+size_t
+global_data_memory_usage(lame_internal_flags const *gfc)
+{
+    PsyConst_t const *const gd = gfc->cd_psy;
+    size_t  bytes;
+    int     i;
+
+    if (gd == 0)
+        return 0;
+    bytes = sizeof(*gd);
+    if (gd->l.s3)
+        for (i = 0; i < gd->l.npart; i++)
+            bytes += (gd->l.s3ind[i][1] - gd->l.s3ind[i][0] + 1) * sizeof(FLOAT);
+    if (gd->s.s3)
+        for (i = 0; i < gd->s.npart; i++)
+            bytes += (gd->s.s3ind[i][1] - gd->s.s3ind[i][0] + 1) * sizeof(FLOAT);
+    return bytes;
+}
+
+
 void
 freegfc(lame_internal_flags * const gfc)
 {                       /* bit stream structure */
@@ -149,6 +203,7 @@ freegfc(lame_internal_flags * const gfc)
     if (gfc->sv_enc.in_buffer_1) {
         free(gfc->sv_enc.in_buffer_1);
     }
+    free(gfc->sv_enc.mfbuf[0]);
     free_id3tag(gfc);
 
 #ifdef DECODE_ON_THE_FLY
@@ -526,6 +581,30 @@ gcd(int i, int j)
 
 
 
+/* length of the resampling filter, filter_l + 1 taps */
+static int
+resample_filter_l(SessionConfig_t const *cfg)
+{
+    double  resample_ratio = (double)cfg->samplerate_in / (double)cfg->samplerate_out;
+    int     filter_l;
+    FLOAT   intratio;
+
+    intratio = (fabs(resample_ratio - floor(.5 + resample_ratio)) < .0001);
+    filter_l = 31;     /* must be odd */
+    filter_l += intratio; /* unless resample_ratio=int, it must be even */
+    return filter_l;
+}
+
+
+/* floor() of a small double as int, without the libm call per sample */
+inline static int
+floor_int(double x)
+{
+    int const i = (int) x;
+    return i - (x < i);
+}
+
+
 static int
 fill_buffer_resample(lame_internal_flags * gfc,
                      sample_t * outbuf,
@@ -538,19 +617,17 @@ fill_buffer_resample(lame_internal_flags * gfc,
     FLOAT   offset, xvalue;
     int     i, j = 0, k;
     int     filter_l;
-    FLOAT   fcn, intratio;
+    FLOAT   fcn;
     FLOAT  *inbuf_old;
     int     bpc;             /* number of convolution functions to pre-compute */
     bpc = cfg->samplerate_out / gcd(cfg->samplerate_out, cfg->samplerate_in);
     if (bpc > BPC)
         bpc = BPC;
 
-    intratio = (fabs(resample_ratio - floor(.5 + resample_ratio)) < .0001);
     fcn = 1.00 / resample_ratio;
     if (fcn > 1.00)
         fcn = 1.00;
-    filter_l = 31;     /* must be odd */
-    filter_l += intratio; /* unless resample_ratio=int, it must be even */
+    filter_l = resample_filter_l(cfg);
 
 
     BLACKSIZE = filter_l + 1; /* size of data needed for FIR */
@@ -584,7 +661,7 @@ fill_buffer_resample(lame_internal_flags * gfc,
         double  time0 = k * resample_ratio; /* time of k'th output sample */
         int     joff;
 
-        j = floor(time0 - esv->itime[ch]);
+        j = floor_int(time0 - esv->itime[ch]);
 
         /* check if we need more input data */
         if ((filter_l + j - filter_l / 2) >= len)
@@ -596,7 +673,7 @@ fill_buffer_resample(lame_internal_flags * gfc,
         assert(fabs(offset) <= .501);
 
         /* find the closest precomputed window for this offset: */
-        joff = floor((offset * 2 * bpc) + bpc + .5);
+        joff = floor_int((offset * 2 * bpc) + bpc + .5);
 
         xvalue = 0.;
         for (i = 0; i <= filter_l; ++i) {
@@ -649,6 +726,43 @@ fill_buffer_resample(lame_internal_flags * gfc,
     return k;           /* return the number samples created at the new samplerate */
 }
 
+/* forget the resampler history, but keep the precomputed filters */
+void
+fill_buffer_reset(lame_internal_flags * gfc)
+{
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    int const BLACKSIZE = resample_filter_l(&gfc->cfg) + 1;
+    int     ch;
+
+    if (gfc->fill_buffer_resample_init == 0)
+        return;
+    for (ch = 0; ch < 2; ++ch) {
+        esv->itime[ch] = 0;
+        if (esv->inbuf_old[ch])
+            memset(esv->inbuf_old[ch], 0, BLACKSIZE * sizeof(esv->inbuf_old[ch][0]));
+    }
+}
+
+/* bytes held by the resampler filters and history, see lame_get_memory_usage() */
+size_t
+fill_buffer_memory_usage(lame_internal_flags const *gfc)
+{
+    EncStateVar_t const *const esv = &gfc->sv_enc;
+    size_t const n = (resample_filter_l(&gfc->cfg) + 1) * sizeof(sample_t);
+    size_t  bytes = 0;
+    int     i;
+
+    if (gfc->fill_buffer_resample_init == 0)
+        return 0;
+    for (i = 0; i <= 2 * BPC; ++i)
+        if (esv->blackfilt[i])
+            bytes += n;
+    for (i = 0; i < 2; ++i)
+        if (esv->inbuf_old[i])
+            bytes += n;
+    return bytes;
+}
+
 int
 isResamplingNecessary(SessionConfig_t const* cfg)
 {
@@ -657,6 +771,82 @@ isResamplingNecessary(SessionConfig_t const* cfg)
     return (cfg->samplerate_in < l) || (h < cfg->samplerate_in) ? 1 : 0;
 }
 
+
+/***********************************************************************
+ *
+ *  tables shared by all instances
+ *
+ *  The first caller of lame_once_begin() gets 1, builds the tables and
+ *  calls lame_once_end().  Other threads calling meanwhile wait until
+ *  the tables are complete, later callers get 0 right away.
+ *
+ ***********************************************************************/
+
+int
+lame_once_begin(int volatile *state)
+{
+    if (*state == 2) {
+        LAME_MEMORY_BARRIER();
+        return 0;
+    }
+    if (LAME_ATOMIC_CAS(state, 0, 1))
+        return 1;
+    while (*state != 2) {
+        /* another thread is building the tables */
+        LAME_CPU_PAUSE();
+    }
+    LAME_MEMORY_BARRIER();
+    return 0;
+}
+
+void
+lame_once_end(int volatile *state)
+{
+    LAME_MEMORY_BARRIER();
+    *state = 2;
+}
+
+
+/***********************************************************************
+ *
+ *  published encoder statistics
+ *
+ *  The histograms and the frame counter in EncResult_t are written by
+ *  the encoding thread only, once per frame.  It makes stats_seq odd
+ *  before and even again after the update.  A reader in another thread
+ *  copies the statistics and retries if stats_seq was odd or changed
+ *  meanwhile, so the encoder never waits for a reader.
+ *
+ ***********************************************************************/
+
+void
+enc_stats_write_begin(EncResult_t * eov)
+{
+    eov->stats_seq++;
+    LAME_MEMORY_BARRIER();
+}
+
+void
+enc_stats_write_end(EncResult_t * eov)
+{
+    LAME_MEMORY_BARRIER();
+    eov->stats_seq++;
+}
+
+void
+enc_stats_read(EncResult_t const * eov, EncResult_t * snapshot)
+{
+    unsigned int seq;
+    do {
+        while ((seq = eov->stats_seq) & 1u) {
+            /* the encoder is in the middle of an update */
+        }
+        LAME_MEMORY_BARRIER();
+        memcpy(snapshot, eov, sizeof(*snapshot));
+        LAME_MEMORY_BARRIER();
+    } while (seq != eov->stats_seq);
+}
+
 /* copy in new samples from in_buffer into mfbuf, with resampling
    if necessary.  n_in = number of samples from the input buffer that
    were used.  n_out = number of samples copied into mfbuf  */
@@ -727,7 +917,9 @@ lame_debugf(const lame_internal_flags* gfc, const char *format, ...)
     if (gfc && gfc->report_dbg) {
         va_list args;
         va_start(args, format);
+        fpu_callback_begin(gfc);
         gfc->report_dbg(format, args);
+        fpu_callback_end(gfc);
         va_end(args);
     }
 }
@@ -739,7 +931,9 @@ lame_msgf(const lame_internal_flags* gfc, const char *format, ...)
     if (gfc && gfc->report_msg) {
         va_list args;
         va_start(args, format);
+        fpu_callback_begin(gfc);
         gfc->report_msg(format, args);
+        fpu_callback_end(gfc);
         va_end(args);
     }
 }
@@ -751,7 +945,9 @@ lame_errorf(const lame_internal_flags* gfc, const char *format, ...)
     if (gfc && gfc->report_err) {
         va_list args;
         va_start(args, format);
+        fpu_callback_begin(gfc);
         gfc->report_err(format, args);
+        fpu_callback_end(gfc);
         va_end(args);
     }
 }
@@ -930,6 +1126,112 @@ disable_FPE(void)
 }
 
 
+/*
+ *  Denormal handling around the public encode and decode calls.
+ *
+ *  Fades into digital silence leave the psy model, the resampler and the
+ *  ReplayGain filters working on denormal numbers, which cost up to a
+ *  hundred cycles per operation on x86. While LAME code runs we switch
+ *  the SSE unit to flush-to-zero / denormals-are-zero and hand the
+ *  caller's mode back on return. The register is only written when it
+ *  actually changes, so nested calls are cheap.
+ *  Elsewhere these are no-ops.
+ */
+#ifdef HAVE_MXCSR_DENORMAL_CONTROL
+/* Every x86-64 CPU has DAZ.  Early 32 bit SSE CPUs do not, and setting it
+ * there raises #GP, so ask MXCSR_MASK from FXSAVE whether the bit exists. */
+static unsigned int
+mxcsr_flush_bits(void)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return MXCSR_FTZ | MXCSR_DAZ;
+#else
+    static unsigned int volatile bits = 0;
+    if (bits == 0) {
+        unsigned char area[512 + 16];
+        unsigned char *fx = area + ((16 - ((size_t) area & 15)) & 15);
+        unsigned int mask;
+        memset(fx, 0, 512);
+        __asm__ __volatile__("fxsave %0":"=m"(*(unsigned char (*)[512]) fx));
+        memcpy(&mask, fx + 28, sizeof(mask));
+        if (mask == 0)
+            mask = 0xffbfu; /* FXSAVE leaves it zero if the CPU has no DAZ */
+        bits = MXCSR_FTZ | (mask & MXCSR_DAZ);
+    }
+    return bits;
+#endif
+}
+#endif
+
+/* seconds on a monotonic wall clock, unaffected by other threads and
+ * by changes of the system time; only differences are meaningful */
+double
+wall_clock_seconds(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER count, freq;
+    if (QueryPerformanceCounter(&count) && QueryPerformanceFrequency(&freq))
+        return (double) count.QuadPart / (double) freq.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return ts.tv_sec + 1e-9 * ts.tv_nsec;
+#endif
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+fpu_mode_t
+fpu_flush_denormals_enter(int enable)
+{
+#ifdef HAVE_MXCSR_DENORMAL_CONTROL
+    fpu_mode_t const saved = _mm_getcsr();
+    if (enable) {
+        unsigned int const bits = mxcsr_flush_bits();
+        if ((saved & bits) != bits)
+            _mm_setcsr(saved | bits);
+    }
+    return saved;
+#else
+    (void) enable;
+    return 0;
+#endif
+}
+
+void
+fpu_flush_denormals_leave(fpu_mode_t saved)
+{
+#ifdef HAVE_MXCSR_DENORMAL_CONTROL
+    /* only restore the flush bits, keep the sticky exception flags */
+    unsigned int const csr = _mm_getcsr();
+    unsigned int const restored =
+        (csr & ~(MXCSR_FTZ | MXCSR_DAZ)) | (saved & (MXCSR_FTZ | MXCSR_DAZ));
+    if (csr != restored) {
+        _mm_setcsr(restored);
+    }
+#else
+    (void) saved;
+#endif
+}
+
+
+
+
+
+/* Application callbacks (PCM source, message reports) run in the
+ * caller's mode, flushing must not change the application's float math. */
+void
+fpu_callback_begin(lame_internal_flags const *gfc)
+{
+    if (gfc->fpu.depth > 0)
+        fpu_flush_denormals_leave(gfc->fpu.caller);
+}
+
+void
+fpu_callback_end(lame_internal_flags const *gfc)
+{
+    if (gfc->fpu.depth > 0)
+        fpu_flush_denormals_leave(gfc->fpu.inside);
+}
 
 
 
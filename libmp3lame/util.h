@@ -27,6 +27,46 @@
 #include "id3tag.h"
 #include "lame_global_flags.h"
 
+/* atomic operations and memory barrier for state shared between threads,
+   LAME_CPU_PAUSE() relaxes the CPU in spin-wait loops */
+#if defined(_MSC_VER)
+#include <intrin.h>
+#pragma intrinsic(_InterlockedCompareExchange, _InterlockedExchangeAdd, _InterlockedExchange)
+#define LAME_ATOMIC_CAS(p, o, n) \
+    (_InterlockedCompareExchange((long volatile *)(p), (long)(n), (long)(o)) == (long)(o))
+#define LAME_ATOMIC_ADD(p, v) _InterlockedExchangeAdd((long volatile *)(p), (long)(v))
+#define LAME_ATOMIC_CAS_PTR(p, o, n) \
+    (_InterlockedCompareExchangePointer((void *volatile *)(p), (void *)(n), (void *)(o)) == (void *)(o))
+#define LAME_MEMORY_BARRIER() \
+    do { long volatile barrier_; (void) _InterlockedExchange(&barrier_, 0); } while (0)
+#if defined(_M_IX86) || defined(_M_X64)
+#define LAME_CPU_PAUSE() _mm_pause()
+#elif defined(_M_ARM) || defined(_M_ARM64)
+#define LAME_CPU_PAUSE() __yield()
+#else
+#define LAME_CPU_PAUSE() ((void) 0)
+#endif
+#elif defined(__GNUC__)
+#define LAME_ATOMIC_CAS(p, o, n) __sync_bool_compare_and_swap((p), (o), (n))
+#define LAME_ATOMIC_ADD(p, v) __sync_fetch_and_add((p), (v))
+#define LAME_ATOMIC_CAS_PTR(p, o, n) __sync_bool_compare_and_swap((p), (o), (n))
+#define LAME_MEMORY_BARRIER() __sync_synchronize()
+#if defined(__i386__) || defined(__x86_64__)
+#define LAME_CPU_PAUSE() __asm__ __volatile__("pause" ::: "memory")
+#elif defined(__aarch64__) || (defined(__arm__) && defined(__ARM_ARCH) && __ARM_ARCH >= 7)
+#define LAME_CPU_PAUSE() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define LAME_CPU_PAUSE() __asm__ __volatile__("" ::: "memory")
+#endif
+#else
+/* no atomic operations known for this compiler, nothing is thread safe */
+#define LAME_ATOMIC_CAS(p, o, n) (*(p) == (o) ? (*(p) = (n), 1) : 0)
+#define LAME_ATOMIC_ADD(p, v) ((*(p) += (v)) - (v))
+#define LAME_ATOMIC_CAS_PTR(p, o, n) LAME_ATOMIC_CAS(p, o, n)
+#define LAME_MEMORY_BARRIER()
+#define LAME_CPU_PAUSE()
+#endif
+
 #ifdef __cplusplus
 extern  "C" {
 #endif
@@ -85,9 +125,6 @@ extern  "C" {
 #define MAX_BITS_PER_CHANNEL 4095
 #define MAX_BITS_PER_GRANULE 7680
 
-/* "bit_stream.h" Definitions */
-#define         BUFFER_SIZE     LAME_MAXMP3BUFFER
-
 #define         Min(A, B)       ((A) < (B) ? (A) : (B))
 #define         Max(A, B)       ((A) > (B) ? (A) : (B))
 
@@ -294,7 +331,8 @@ extern  "C" {
 #ifndef  MFSIZE
 # define MFSIZE  ( 3*1152 + ENCDELAY - MDCTDELAY )
 #endif
-        sample_t mfbuf[2][MFSIZE];
+        /* MFSIZE samples per output channel; mfbuf[1] is mfbuf[0] for mono */
+        sample_t *mfbuf[2];
 
         int     mf_samples_to_encode;
         int     mf_size;
@@ -303,9 +341,12 @@ extern  "C" {
 
 
     typedef struct {
-        /* simple statistics */
+        /* simple statistics, written between enc_stats_write_begin() and
+         * enc_stats_write_end(); other threads read them with enc_stats_read() */
+        unsigned int volatile stats_seq; /* odd while the statistics are written */
         int     bitrate_channelmode_hist[16][4 + 1];
         int     bitrate_blocktype_hist[16][4 + 1 + 1]; /*norm/start/short/stop/mixed(short)/sum */
+        int     vbr_recovery_hist[5]; /* VBR-new granules over budget, see lame_vbr_recovery_hist */
 
         int     bitrate_index;
         int     frame_number; /* number of frames encoded             */
@@ -337,6 +378,12 @@ extern  "C" {
 
 
         char    bv_scf[576];
+
+        int     vbr_recovery_count[5]; /* copied to ov_enc.vbr_recovery_hist once per frame */
+
+        /* gr_info width[] and window[] for long, short and mixed blocks */
+        int     sfb_width[3][SFBMAX];
+        int     sfb_window[3][SFBMAX];
     } QntStateVar_t;
 
 
@@ -461,6 +508,8 @@ extern  "C" {
     } SessionConfig_t;
 
 
+    typedef unsigned int fpu_mode_t;
+
     struct lame_internal_flags {
 
   /********************************************************************
@@ -532,11 +581,38 @@ extern  "C" {
         plotting_data *pinfo;
         hip_t hip;
 
+        /* MP3 input of lame_transcode_buffer(), see mpglib_interface.c */
+        struct {
+            hip_t   hip;     /* decoder of the current stream, 0 before the first frame */
+            int     skip;    /* decoded samples still to drop: decoder and source encoder delay */
+            int     limited; /* source length known from its LAME tag */
+            unsigned long remaining; /* decoded samples left before the source padding */
+        } transcode;
+
+        /* wall time [s] of the lame_init_params() phases, see lame_print_internals() */
+        struct {
+            double  total;
+            double  buffers;  /* bit buffer and frame buffer */
+            double  tags;     /* ID3v2 tag and VBR tag frame */
+            double  tables;   /* quantizer and MDCT tables */
+            double  psymodel; /* psychoacoustic constants */
+        } init_time;
+
+        /* floating point mode of the library call in progress, so that
+           application callbacks run in the caller's mode, see util.c */
+        struct {
+            int     depth;    /* nesting of encoder_fpu_enter() in lame.c */
+            fpu_mode_t caller; /* mode of the application */
+            fpu_mode_t inside; /* mode while the library runs */
+        } fpu;
+
         /* functions to replace with CPU feature optimized versions in takehiro.c */
         int     (*choose_table) (const int *ix, const int *const end, int *const s);
         void    (*fft_fht) (FLOAT *, int);
         void    (*init_xrpow_core) (gr_info * const cod_info, FLOAT xrpow[576], int upper,
                                     FLOAT * sum);
+        void    (*attack_hpf_peaks) (FLOAT const *coef, const sample_t * const firbuf[2],
+                                     int n_chn, int ms, FLOAT peaks[4][9]);
 
         lame_report_function report_msg;
         lame_report_function report_dbg;
@@ -556,6 +632,8 @@ extern  "C" {
 ***********************************************************************/
     void    freegfc(lame_internal_flags * const gfc);
     void    free_id3tag(lame_internal_flags * const gfc);
+    size_t  id3tag_memory_usage(lame_internal_flags const *gfc);
+    size_t  global_data_memory_usage(lame_internal_flags const *gfc);
     extern int BitrateIndex(int, int, int);
     extern int FindNearestBitrate(int, int, int);
     extern int map2MP3Frequency(int freq);
@@ -565,15 +643,32 @@ extern  "C" {
     extern FLOAT freq2bark(FLOAT freq);
     void    disable_FPE(void);
 
+    extern double wall_clock_seconds(void);
+
+/* flush-to-zero mode for the duration of one library call */
+    extern fpu_mode_t fpu_flush_denormals_enter(int enable);
+    extern void fpu_flush_denormals_leave(fpu_mode_t saved);
+    extern void fpu_callback_begin(lame_internal_flags const *gfc);
+    extern void fpu_callback_end(lame_internal_flags const *gfc);
+
 /* log/log10 approximations */
     extern void init_log_table(void);
     extern ieee754_float32_t fast_log2(ieee754_float32_t x);
 
     int     isResamplingNecessary(SessionConfig_t const* cfg);
 
+    int     lame_once_begin(int volatile *state);
+    void    lame_once_end(int volatile *state);
+
+    void    enc_stats_write_begin(EncResult_t * eov);
+    void    enc_stats_write_end(EncResult_t * eov);
+    void    enc_stats_read(EncResult_t const * eov, EncResult_t * snapshot);
+
     void    fill_buffer(lame_internal_flags * gfc,
                         sample_t *const mfbuf[2],
                         sample_t const *const in_buffer[2], int nsamples, int *n_in, int *n_out);
+    void    fill_buffer_reset(lame_internal_flags * gfc);
+    size_t  fill_buffer_memory_usage(lame_internal_flags const *gfc);
 
 /* same as lame_decode1 (look in lame.h), but returns
    unclipped raw floating-point samples. It is declared
@@ -583,6 +678,9 @@ extern  "C" {
     int     hip_decode1_unclipped(hip_t hip, unsigned char *mp3buf,
                                    size_t len, sample_t pcm_l[], sample_t pcm_r[]);
 
+/* bytes held by a hip decoder, including buffered input */
+    size_t  hip_memory_usage(hip_t hip);
+
 
     extern int has_MMX(void);
     extern int has_3DNow(void);
@@ -105,11 +105,10 @@ typedef VOLATILE union {
 #  define XRPOW_FTOI(src,dest) ((dest) = (int)(src))
 #endif
 
+#ifdef TAKEHIRO_IEEE754_HACK
 static int const MAGIC_INT = MAGIC_INT_def;
-#ifndef TAKEHIRO_IEEE754_HACK
-static DOUBLEX const ROUNDFAC = ROUNDFAC_def;
-#endif
 static DOUBLEX const MAGIC_FLOAT = MAGIC_FLOAT_def;
+#endif
 
 
 inline static  float
@@ -1028,6 +1027,7 @@ tryGlobalStepsize(const algo_t * that, const int sfwork[SFBMAX],
         }
         sftemp[i] = gain;
     }
+    that->gfc->sv_qnt.vbr_recovery_count[4]++;
     that->alloc(that, sftemp, vbrsfmin, vbrmax);
     bitcount(that);
     nbits = quantizeAndCountBits(that);
@@ -1142,6 +1142,7 @@ tryThatOne(algo_t const* that, const int sftemp[SFBMAX], const int vbrsfmin[SFBM
 {
     FLOAT const xrpow_max = that->cod_info->xrpow_max;
     int     nbits = LARGE_BITS;
+    that->gfc->sv_qnt.vbr_recovery_count[4]++;
     that->alloc(that, sftemp, vbrsfmin, vbrmax);
     bitcount(that);
     nbits = quantizeAndCountBits(that);
@@ -1151,79 +1152,103 @@ tryThatOne(algo_t const* that, const int sftemp[SFBMAX], const int vbrsfmin[SFBM
 }
 
 
+/*
+ * Find the smallest flattening x in [lo, hi] that fits into target bits;
+ * x is the flattening depth k (raise == 0) or the common scalefactor
+ * (raise != 0).  The bit count falls about linearly with x, so instead of
+ * halving, the next probe goes where the line through the closest failing
+ * and fitting probes crosses target.  After three probes in a row on the
+ * same side it bisects once, to keep the worst case near a binary search.
+ * x0 has already been probed, giving n0 bits.  Returns -1 if nothing fits,
+ * otherwise the granule is left quantized with the returned flattening.
+ */
+static int
+searchFlattening(algo_t const *that, const int sfwork[SFBMAX], const int vbrsfmin[SFBMAX],
+                 int target, int dm, int p, int raise, int lo, int hi, int x0, int n0)
+{
+    gr_info *const cod_info = that->cod_info;
+    gr_info best;
+    int     wrk[SFBMAX];
+    int     fail = lo - 1, n_fail = -1;
+    int     fit = hi + 1, n_fit = -1;
+    int     x = x0, nbits = n0;
+    int     side = -1, run = 0;
+
+    for (;;) {
+        int const fits = nbits <= target;
+        if (fits) {
+            fit = x;
+            n_fit = nbits;
+            memcpy(&best, cod_info, GR_INFO_STATE_SIZE);
+        }
+        else {
+            fail = x;
+            n_fail = nbits;
+        }
+        run = side == fits ? run + 1 : 1;
+        side = fits;
+        if (fit - fail <= 1) {
+            break;
+        }
+        if (run < 3 && n_fit >= 0 && n_fail > n_fit) {
+            x = fail + 1 + (n_fail - target) * (fit - fail) / (n_fail - n_fit);
+            if (x >= fit) {
+                x = fit - 1;
+            }
+        }
+        else {
+            x = (fail + fit) / 2;
+            run = 0;
+        }
+        {
+            int const sfmax = raise ? flattenDistribution(sfwork, wrk, dm, dm, x)
+                                    : flattenDistribution(sfwork, wrk, dm, x, p);
+            nbits = tryThatOne(that, wrk, vbrsfmin, sfmax);
+        }
+    }
+    if (fit > hi) {
+        return -1;
+    }
+    if (x != fit) {
+        memcpy(cod_info, &best, GR_INFO_STATE_SIZE);
+    }
+    return fit;
+}
+
+
 static void
 outOfBitsStrategy(algo_t const* that, const int sfwork[SFBMAX], const int vbrsfmin[SFBMAX], int target)
 {
+    int    *const hist = that->gfc->sv_qnt.vbr_recovery_count;
     int     wrk[SFBMAX];
     int const dm = sfDepth(sfwork);
     int const p = that->cod_info->global_gain;
-    int     nbits;
+    int     sfmax, nbits;
 
-    /* PART 1 */
-    {
-        int     bi = dm / 2;
-        int     bi_ok = -1;
-        int     bu = 0;
-        int     bo = dm;
-        for (;;) {
-            int const sfmax = flattenDistribution(sfwork, wrk, dm, bi, p);
-            nbits = tryThatOne(that, wrk, vbrsfmin, sfmax);
-            if (nbits <= target) {
-                bi_ok = bi;
-                bo = bi - 1;
-            }
-            else {
-                bu = bi + 1;
-            }
-            if (bu <= bo) {
-                bi = (bu + bo) / 2;
-            }
-            else {
-                break;
-            }
-        }
-        if (bi_ok >= 0) {
-            if (bi != bi_ok) {
-                int const sfmax = flattenDistribution(sfwork, wrk, dm, bi_ok, p);
-                nbits = tryThatOne(that, wrk, vbrsfmin, sfmax);
-            }
-            return;
-        }
+    hist[0]++;
+
+    /* PART 1: flatten the distribution towards the global gain p; if even
+     * the fully flattened one does not fit, no partial flattening will
+     */
+    sfmax = flattenDistribution(sfwork, wrk, dm, dm, p);
+    nbits = tryThatOne(that, wrk, vbrsfmin, sfmax);
+    if (nbits <= target) {
+        searchFlattening(that, sfwork, vbrsfmin, target, dm, p, 0, 0, dm, dm, nbits);
+        hist[1]++;
+        return;
     }
 
-    /* PART 2: */
-    {
-        int     bi = (255 + p) / 2;
-        int     bi_ok = -1;
-        int     bu = p;
-        int     bo = 255;
-        for (;;) {
-            int const sfmax = flattenDistribution(sfwork, wrk, dm, dm, bi);
-            nbits = tryThatOne(that, wrk, vbrsfmin, sfmax);
-            if (nbits <= target) {
-                bi_ok = bi;
-                bo = bi - 1;
-            }
-            else {
-                bu = bi + 1;
-            }
-            if (bu <= bo) {
-                bi = (bu + bo) / 2;
-            }
-            else {
-                break;
-            }
-        }
-        if (bi_ok >= 0) {
-            if (bi != bi_ok) {
-                int const sfmax = flattenDistribution(sfwork, wrk, dm, dm, bi_ok);
-                nbits = tryThatOne(that, wrk, vbrsfmin, sfmax);
-            }
-            return;
-        }
+    /* PART 2: raise the flat distribution above p, which is the same as
+     * the full flattening probed above
+     */
+    if (searchFlattening(that, sfwork, vbrsfmin, target, dm, p, 1, p, 255, p, nbits) >= 0) {
+        hist[2]++;
+        return;
     }
 
     /* fall back to old code, likely to be never called */
+    hist[3]++;
+    flattenDistribution(sfwork, wrk, dm, dm, 255);
     searchGlobalStepsizeMax(that, wrk, vbrsfmin, target);
 }
 
@@ -30,4 +30,8 @@ init_xrpow_core_sse(gr_info * const cod_info, FLOAT xrpow[576], int upper, FLOAT
 void
 fht_SSE2(FLOAT* , int);
 
+void
+attack_hpf_peaks_sse(FLOAT const *coef, const sample_t * const firbuf[2], int n_chn, int ms,
+                     FLOAT peaks[4][9]);
+
 #endif
@@ -228,5 +228,64 @@ fht_SSE2(FLOAT * fz, int n)
     } while (k4 < n);
 }
 
+
+/* largest of the 4 lanes and p */
+static float
+hmax_ps(__m128 v, float p)
+{
+    vecfloat_union x;
+    int     i;
+    x._m128 = v;
+    for (i = 0; i < 4; ++i) {
+        if (p < x._float[i])
+            p = x._float[i];
+    }
+    return p;
+}
+
+/* same operation order as attack_hpf_peaks_c(), 4 samples at a time */
+void
+attack_hpf_peaks_sse(FLOAT const *coef, const sample_t * const firbuf[2], int n_chn, int ms,
+                     FLOAT peaks[4][9])
+{
+    __m128 const sign = _mm_set1_ps(-0.f);
+    __m128  c[10];
+    __m128  pmax[4][9];
+    int     chn, i, j, k;
+
+    for (j = 0; j < 10; j++)
+        c[j] = _mm_set1_ps(coef[j]);
+    for (chn = 0; chn < 4; chn++)
+        for (k = 0; k < 9; k++)
+            pmax[chn][k] = _mm_set1_ps(1.f);
+
+    for (k = 0; k < 9; k++) {
+        for (i = 0; i < 576 / 9; i += 4) {
+            __m128  y[2];
+            for (chn = 0; chn < n_chn; chn++) {
+                sample_t const *const x = firbuf[chn] + k * (576 / 9) + i;
+                __m128  sum1 = _mm_loadu_ps(x + 10);
+                __m128  sum2 = _mm_setzero_ps();
+                for (j = 0; j < 10 - 1; j += 2) {
+                    __m128 const a = _mm_add_ps(_mm_loadu_ps(x + j), _mm_loadu_ps(x + 21 - j));
+                    __m128 const b = _mm_add_ps(_mm_loadu_ps(x + j + 1), _mm_loadu_ps(x + 20 - j));
+                    sum1 = _mm_add_ps(sum1, _mm_mul_ps(c[j], a));
+                    sum2 = _mm_add_ps(sum2, _mm_mul_ps(c[j + 1], b));
+                }
+                y[chn] = _mm_add_ps(sum1, sum2);
+                pmax[chn][k] = _mm_max_ps(pmax[chn][k], _mm_andnot_ps(sign, y[chn]));
+            }
+            if (ms) {
+                /* mid and side */
+                pmax[2][k] = _mm_max_ps(pmax[2][k], _mm_andnot_ps(sign, _mm_add_ps(y[0], y[1])));
+                pmax[3][k] = _mm_max_ps(pmax[3][k], _mm_andnot_ps(sign, _mm_sub_ps(y[0], y[1])));
+            }
+        }
+    }
+    for (chn = 0; chn < (ms ? 4 : n_chn); chn++)
+        for (k = 0; k < 9; k++)
+            peaks[chn][k] = hmax_ps(pmax[chn][k], 1.f);
+}
+
 #endif	/* HAVE_XMMINTRIN_H */
 
@@ -0,0 +1,234 @@
+/*
+ *  Usage: mp2bench [frames [joint]]
+ *
+ *  Layer I/II decoding speed of hip_decode1(). Writes synthetic MPEG-1
+ *  frames, 48 kHz stereo at 384 kbps, with random allocations, scalefactors
+ *  and samples that fill the whole frame, and decodes them several times.
+ *  Prints the best run and a checksum of the PCM output, so a change to
+ *  the decoder can be timed and checked for identical output.
+ *
+ *  Example: mp2bench 3000      ~72 s of audio per layer
+ *           mp2bench 3000 1    same in joint stereo
+ *
+ *  Build:   make -C misc mp2bench
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lame.h"
+#include "mpg123.h"
+#include "mpglib.h"
+#include "layer2.h"
+/* allocation table of 27 and 30 subband streams, defined in l2tables.h */
+extern const struct al_table2 alloc_0[];
+
+#define RUNS 5
+
+static unsigned char *frame;
+static int bitpos;
+
+static void
+putbits(unsigned int val, int nbits)
+{
+    while (nbits--) {
+        if ((val >> nbits) & 1)
+            frame[bitpos >> 3] |= 0x80 >> (bitpos & 7);
+        bitpos++;
+    }
+}
+
+static void
+header(int layer, int bitrate_index, int joint)
+{
+    putbits(0xFFF, 12);         /* sync */
+    putbits(1, 1);              /* MPEG-1 */
+    putbits(4 - layer, 2);
+    putbits(1, 1);              /* no CRC */
+    putbits(bitrate_index, 4);
+    putbits(1, 2);              /* 48 kHz */
+    putbits(0, 2);              /* no padding, private bit */
+    putbits(joint ? 1 : 0, 2);  /* stereo or joint stereo */
+    putbits(joint ? 1 : 0, 2);  /* intensity from subband 8 */
+    putbits(0, 4);
+}
+
+/* Layer I: 384 bytes per frame */
+static void
+make_layer1(unsigned char *buf, int joint)
+{
+    int     alloc[32][2], used = 32, sb, ch, s;
+    int     jsbound = joint ? 8 : 32;
+
+    memset(buf, 0, 384);
+    frame = buf;
+    bitpos = 0;
+    header(1, 12, joint);
+    for (sb = 0; sb < 32; sb++) {
+        int     n0 = sb < 20 ? 1 + rand() % 8 : (rand() % 2 ? 0 : 1 + rand() % 4);
+        int     n1 = sb < jsbound ? 1 + rand() % 8 : n0;
+        int     cost = (n0 ? 6 : 0) + (n1 ? 6 : 0) + 12 * (n0 ? n0 + 1 : 0);
+        if (sb < jsbound)
+            cost += 12 * (n1 ? n1 + 1 : 0);
+        used += sb < jsbound ? 8 : 4;
+        if (used + cost > 384 * 8)
+            n0 = n1 = cost = 0;
+        alloc[sb][0] = n0;
+        alloc[sb][1] = n1;
+        used += cost;
+    }
+    for (sb = 0; sb < 32; sb++) {
+        putbits(alloc[sb][0], 4);
+        if (sb < jsbound)
+            putbits(alloc[sb][1], 4);
+    }
+    for (sb = 0; sb < 32; sb++)
+        for (ch = 0; ch < 2; ch++)
+            if (alloc[sb][ch])
+                putbits(6 + rand() % 10, 6);
+    for (s = 0; s < 12; s++)
+        for (sb = 0; sb < 32; sb++)
+            for (ch = 0; ch < (sb < jsbound ? 2 : 1); ch++)
+                if (alloc[sb][ch])
+                    putbits(rand() & ((1 << (alloc[sb][ch] + 1)) - 1), alloc[sb][ch] + 1);
+}
+
+/* bits of the three samples of one granule */
+static int
+triple_bits(struct al_table2 const *a, int b)
+{
+    if (b == 0)
+        return 0;
+    return a[b].d < 0 ? 3 * a[b].bits : a[b].bits;
+}
+
+/* Layer II, allocation table alloc_0: 1152 bytes per frame */
+static void
+make_layer2(unsigned char *buf, int joint)
+{
+    struct al_table2 const *a;
+    int     ba[27][2], used = 32, sb, ch, gr, s;
+    int     sblimit = 27, jsbound = joint ? 8 : 27;
+
+    memset(buf, 0, 1152);
+    frame = buf;
+    bitpos = 0;
+    header(2, 14, joint);
+    for (a = alloc_0, sb = 0; sb < sblimit; a += 1 << a->bits, sb++) {
+        int     b0 = sb > 20 && rand() % 3 ? 0 : rand() % (1 << a->bits);
+        int     b1 = sb < jsbound ? rand() % (1 << a->bits) : b0;
+        int     cost = (b0 ? 20 : 0) + (b1 ? 20 : 0) + 12 * triple_bits(a, b0);
+        if (sb < jsbound)
+            cost += 12 * triple_bits(a, b1);
+        used += a->bits * (sb < jsbound ? 2 : 1);
+        if (used + cost > 1152 * 8)
+            b0 = b1 = cost = 0;
+        ba[sb][0] = b0;
+        ba[sb][1] = b1;
+        used += cost;
+    }
+    for (a = alloc_0, sb = 0; sb < sblimit; a += 1 << a->bits, sb++) {
+        putbits(ba[sb][0], a->bits);
+        if (sb < jsbound)
+            putbits(ba[sb][1], a->bits);
+    }
+    for (sb = 0; sb < sblimit; sb++)
+        for (ch = 0; ch < 2; ch++)
+            if (ba[sb][ch])
+                putbits(0, 2); /* scfsi: three scalefactors */
+    for (sb = 0; sb < sblimit; sb++)
+        for (ch = 0; ch < 2; ch++)
+            if (ba[sb][ch])
+                for (s = 0; s < 3; s++)
+                    putbits(4 + sb / 2 + rand() % 8, 6);
+    for (gr = 0; gr < 12; gr++) {
+        for (a = alloc_0, sb = 0; sb < sblimit; a += 1 << a->bits, sb++) {
+            for (ch = 0; ch < (sb < jsbound ? 2 : 1); ch++) {
+                int     b = ba[sb][ch];
+                if (!b)
+                    continue;
+                if (a[b].d < 0) {
+                    for (s = 0; s < 3; s++)
+                        putbits(rand() & ((1 << a[b].bits) - 1), a[b].bits);
+                }
+                else {
+                    putbits(rand() % (a[b].d * a[b].d * a[b].d), a[b].bits);
+                }
+            }
+        }
+    }
+}
+
+static double
+decode(unsigned char const *stream, long size, int framesize, unsigned long *checksum)
+{
+    static short pcm_l[1152], pcm_r[1152];
+    double  best = 1e30;
+    int     run;
+
+    for (run = 0; run < RUNS; run++) {
+        hip_t   hip = hip_decode_init();
+        clock_t t0 = clock();
+        unsigned long sum = 0;
+        long    pos;
+        double  t;
+
+        for (pos = 0; pos <= size; pos += framesize) {
+            /* an empty buffer at the end flushes the last frame */
+            int     n = hip_decode1(hip, (unsigned char *) stream + pos,
+                                    pos < size ? framesize : 0, pcm_l, pcm_r);
+            int     i;
+            for (i = 0; i < n; i++)
+                sum = sum * 31 + (unsigned short) pcm_l[i] * 3 + (unsigned short) pcm_r[i];
+        }
+        t = (double) (clock() - t0) / CLOCKS_PER_SEC;
+        if (t < best)
+            best = t;
+        *checksum = sum;
+        hip_decode_exit(hip);
+    }
+    return best;
+}
+
+int
+main(int argc, char **argv)
+{
+    int     frames = argc > 1 ? atoi(argv[1]) : 3000;
+    int     joint = argc > 2 ? atoi(argv[2]) : 0;
+    int     layer;
+
+    if (frames <= 0) {
+        fprintf(stderr, "usage: %s [frames [joint]]\n", argv[0]);
+        return 1;
+    }
+    for (layer = 1; layer <= 2; layer++) {
+        int const framesize = layer == 1 ? 384 : 1152;
+        int const samples = layer == 1 ? 384 : 1152;
+        unsigned char *stream = malloc((size_t) frames * framesize);
+        unsigned long checksum = 0;
+        double  t;
+        int     i;
+
+        if (stream == NULL)
+            return 1;
+        srand(1);
+        for (i = 0; i < frames; i++) {
+            if (layer == 1)
+                make_layer1(stream + (size_t) i * framesize, joint);
+            else
+                make_layer2(stream + (size_t) i * framesize, joint);
+        }
+        t = decode(stream, (long) frames * framesize, framesize, &checksum);
+        printf("Layer %s %s: %d frames, best of %d %.3f s, %.0fx realtime, checksum %08lx\n",
+               layer == 1 ? "I " : "II", joint ? "joint stereo" : "stereo", frames, RUNS, t,
+               (double) frames * samples / 48000. / (t > 0 ? t : 1e-9), checksum & 0xffffffffUL);
+        free(stream);
+    }
+    return 0;
+}
@@ -105,6 +105,10 @@ get_II_stuff(struct frame *fr)
 
 #define HDRCMPMASK 0xfffffd00
 
+/* header bits that can change between frames of one stream format:
+ * bitrate index and padding bit */
+#define HDRFASTMASK 0xffff0dff
+
 #define MAX_INPUT_FRAMESIZE 4096
 
 int
@@ -178,6 +182,33 @@ print_header_compact(PMPSTR mp, struct frame *fr)
 
 #endif
 
+/*
+ * frame size in bytes, without the 4 header bytes,
+ * 0 for a free format layer III frame
+ */
+static int
+frame_size(struct frame const *fr)
+{
+    long    size;
+
+    switch (fr->lay) {
+    case 1:
+        size = (long) tabsel_123[fr->lsf][0][fr->bitrate_index] * 12000;
+        size /= freqs[fr->sampling_frequency];
+        return (int) (((size + fr->padding) << 2) - 4);
+    case 2:
+        size = (long) tabsel_123[fr->lsf][1][fr->bitrate_index] * 144000;
+        size /= freqs[fr->sampling_frequency];
+        return (int) (size + fr->padding - 4);
+    default:
+        if (fr->bitrate_index == 0)
+            return 0;
+        size = (long) tabsel_123[fr->lsf][2][fr->bitrate_index] * 144000;
+        size /= freqs[fr->sampling_frequency] << (fr->lsf);
+        return (int) (size + fr->padding - 4);
+    }
+}
+
 /*
  * decode a header and write the information
  * into the frame structure
@@ -185,7 +216,18 @@ print_header_compact(PMPSTR mp, struct frame *fr)
 int
 decode_header(PMPSTR mp, struct frame *fr, unsigned long newhead)
 {
-
+    /* same stream format as the last header: only the bitrate
+     * and the padding, and so the frame size, need updating */
+    if (fr == &mp->fr && mp->fr_head != 0 && ((newhead ^ mp->fr_head) & HDRFASTMASK) == 0) {
+        if (newhead != mp->fr_head) {
+            fr->bitrate_index = ((newhead >> 12) & 0xf);
+            fr->padding = ((newhead >> 9) & 0x1);
+            fr->framesize = frame_size(fr);
+            mp->fr_head = newhead;
+        }
+        return 1;
+    }
+    mp->fr_head = 0;
 
     if (newhead & (1 << 20)) {
         fr->lsf = (newhead & (1 << 19)) ? 0x0 : 0x1;
@@ -226,17 +268,13 @@ decode_header(PMPSTR mp, struct frame *fr, unsigned long newhead)
 
     switch (fr->lay) {
     case 1:
-        fr->framesize = (long) tabsel_123[fr->lsf][0][fr->bitrate_index] * 12000;
-        fr->framesize /= freqs[fr->sampling_frequency];
-        fr->framesize = ((fr->framesize + fr->padding) << 2) - 4;
+        fr->framesize = frame_size(fr);
         fr->down_sample = 0;
         fr->down_sample_sblimit = SBLIMIT >> (fr->down_sample);
         break;
 
     case 2:
-        fr->framesize = (long) tabsel_123[fr->lsf][1][fr->bitrate_index] * 144000;
-        fr->framesize /= freqs[fr->sampling_frequency];
-        fr->framesize += fr->padding - 4;
+        fr->framesize = frame_size(fr);
         fr->down_sample = 0;
         fr->down_sample_sblimit = SBLIMIT >> (fr->down_sample);
         break;
@@ -261,13 +299,7 @@ decode_header(PMPSTR mp, struct frame *fr, unsigned long newhead)
         }
 
 
-        if (fr->bitrate_index == 0)
-            fr->framesize = 0;
-        else {
-            fr->framesize = (long) tabsel_123[fr->lsf][2][fr->bitrate_index] * 144000;
-            fr->framesize /= freqs[fr->sampling_frequency] << (fr->lsf);
-            fr->framesize = fr->framesize + fr->padding - 4;
-        }
+        fr->framesize = frame_size(fr);
         break;
     default:
         lame_report_fnc(mp->report_err, "Sorry, layer %d not supported\n", fr->lay);
@@ -275,6 +307,8 @@ decode_header(PMPSTR mp, struct frame *fr, unsigned long newhead)
     }
     /*    print_header(mp, fr); */
 
+    if (fr == &mp->fr)
+        mp->fr_head = newhead;
     return 1;
 }
 
@@ -40,4 +40,50 @@ unsigned char get_leq_8_bits(PMPSTR mp, unsigned int number_of_bits);
 unsigned short get_leq_16_bits(PMPSTR mp, unsigned int number_of_bits);
 int     set_pointer(PMPSTR mp, long backstep);
 
+/* Read position for the Layer I/II sample loops. getbits() keeps it in
+ * PMPSTR behind a call into common.c for every sample; a local copy can
+ * live in registers. Take it with bitreader_init() and hand it back with
+ * bitreader_done(). */
+typedef struct {
+    unsigned char *wordpointer;
+    int     bitindex;
+} bitreader_t;
+
+static inline void
+bitreader_init(bitreader_t * br, PMPSTR mp)
+{
+    br->wordpointer = mp->wordpointer;
+    br->bitindex = mp->bitindex;
+}
+
+static inline void
+bitreader_done(bitreader_t const * br, PMPSTR mp)
+{
+    mp->wordpointer = br->wordpointer;
+    mp->bitindex = br->bitindex;
+}
+
+/* same as getbits(), for 0 <= number_of_bits <= 16 */
+static inline unsigned int
+bitreader_get(bitreader_t * br, int number_of_bits)
+{
+    unsigned long rval;
+
+    rval = br->wordpointer[0];
+    rval <<= 8;
+    rval |= br->wordpointer[1];
+    rval <<= 8;
+    rval |= br->wordpointer[2];
+    rval <<= br->bitindex;
+    rval &= 0xffffff;
+
+    br->bitindex += number_of_bits;
+
+    rval >>= (24 - number_of_bits);
+
+    br->wordpointer += (br->bitindex >> 3);
+    br->bitindex &= 7;
+    return rval;
+}
+
 #endif
@@ -291,6 +291,10 @@ check_vbr_header(PMPSTR mp, int bytes)
 
 
 
+/* header bits of the MPEG version, sampling frequency and mode: if they
+ * are those of the current frame, the free_match test below holds */
+#define HDRFORMATMASK 0x00180cc0
+
 static int
 sync_buffer(PMPSTR mp, int free_match)
 {
@@ -338,7 +342,7 @@ sync_buffer(PMPSTR mp, int free_match)
             head |= b[3];
             h = head_check(head, fr->lay);
 
-            if (h && free_match) {
+            if (h && free_match && (mp->fr_head == 0 || ((head ^ mp->fr_head) & HDRFORMATMASK) != 0)) {
                 /* just to be even more thorough, match the sample rate */
                 int     mode, stereo, sampling_frequency, mpeg25, lsf;
 
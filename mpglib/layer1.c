@@ -52,6 +52,7 @@ typedef struct sideinfo_layer_I_struct
 {
     unsigned char allocation[SBLIMIT][2]; 
     unsigned char scalefactor[SBLIMIT][2];
+    real    scale[2][SBLIMIT];           /* step size, 0 if not coded */
 } sideinfo_layer_I;
 
 static void
@@ -59,7 +60,8 @@ I_step_one(PMPSTR mp, sideinfo_layer_I* si)
 {
     struct frame *fr = &(mp->fr);
     int     jsbound = (fr->mode == MPG_MD_JOINT_STEREO) ? (fr->mode_ext << 2) + 4 : 32;
-    int     i;
+    int     ds_limit = fr->down_sample_sblimit;
+    int     i, ch;
     memset(si, 0, sizeof(*si));
     assert(fr->stereo == 1 || fr->stereo == 2);
 
@@ -95,86 +97,85 @@ I_step_one(PMPSTR mp, sideinfo_layer_I* si)
             si->scalefactor[i][0] = b0;
         }
     }
+
+    /* the step sizes hold for all twelve samples of the frame */
+    for (ch = 0; ch < fr->stereo; ch++) {
+        for (i = 0; i < ds_limit; i++) {
+            unsigned char n = si->allocation[i][ch];
+            unsigned char x = si->scalefactor[i][ch];
+            assert( n < 16 );
+            assert( x < 64 );
+            if (n > 0) {
+                si->scale[ch][i] = muls[n + 1][x];
+            }
+        }
+    }
 }
 
+/*
+ * Read one sample per subband and channel. The signed levels go into
+ * fraction[] and are then scaled in one pass over the whole row, which
+ * the compiler vectorizes. A 16 bit level times a float needs up to 40
+ * bits, exact in double but not in float. The former version rounded
+ * the exact double product once to float, as a float multiply does, so
+ * the results are the same bit for bit.
+ */
 static void
 I_step_two(PMPSTR mp, sideinfo_layer_I *si, real fraction[2][SBLIMIT])
 {
-    double  r0, r1;
     struct frame *fr = &(mp->fr);
-    int     ds_limit = fr->down_sample_sblimit;
-    int     i;
+    int     i, ch;
+    bitreader_t br;
 
     assert(fr->stereo == 1 || fr->stereo == 2);
+    bitreader_init(&br, mp);
     if (fr->stereo == 2) {
         int     jsbound = (fr->mode == MPG_MD_JOINT_STEREO) ? (fr->mode_ext << 2) + 4 : 32;
         for (i = 0; i < jsbound; i++) {
-            unsigned char i0 = si->scalefactor[i][0];
-            unsigned char i1 = si->scalefactor[i][1];
             unsigned char n0 = si->allocation[i][0];
             unsigned char n1 = si->allocation[i][1];
-            assert( i0 < 64 );
-            assert( i1 < 64 );
-            assert( n0 < 16 );
-            assert( n1 < 16 );
+            int     w0 = 0, w1 = 0;
             if (n0 > 0) {
-                unsigned short v = get_leq_16_bits(mp, n0 + 1); /* 0-65535 */
-                r0 = (((-1) << n0) + v + 1) * muls[n0 + 1][i0];
-            }
-            else {
-                r0 = 0;
+                unsigned int v = bitreader_get(&br, n0 + 1); /* 0-65535 */
+                w0 = ((-1) << n0) + v + 1;
             }
             if (n1 > 0) {
-                unsigned short v = get_leq_16_bits(mp, n1 + 1); /* 0-65535 */
-                r1 = (((-1) << n1) + v + 1) * muls[n1 + 1][i1];
+                unsigned int v = bitreader_get(&br, n1 + 1); /* 0-65535 */
+                w1 = ((-1) << n1) + v + 1;
             }
-            else {
-                r1 = 0;
-            }
-            fraction[0][i] = (real)r0;
-            fraction[1][i] = (real)r1;
+            fraction[0][i] = (real) w0;
+            fraction[1][i] = (real) w1;
         }
         for (i = jsbound; i < SBLIMIT; i++) {
-            unsigned char i0 = si->scalefactor[i][0];
-            unsigned char i1 = si->scalefactor[i][1];
             unsigned char n = si->allocation[i][0];
-            assert( i0 < 64 );
-            assert( i1 < 64 );
-            assert( n < 16 );
+            int     w = 0;
             if (n > 0) {
-                unsigned short v = get_leq_16_bits(mp, n + 1); /* 0-65535 */
-                unsigned int w = (((-1) << n) + v + 1);
-                r0 = w * muls[n + 1][i0];
-                r1 = w * muls[n + 1][i1];
-            }
-            else {
-                r0 = r1 = 0;
+                unsigned int v = bitreader_get(&br, n + 1); /* 0-65535 */
+                w = ((-1) << n) + v + 1;
             }
-            fraction[0][i] = (real)r0;
-            fraction[1][i] = (real)r1;
-        }
-        for (i = ds_limit; i < SBLIMIT; i++) {
-            fraction[0][i] = 0.0;
-            fraction[1][i] = 0.0;
+            fraction[0][i] = (real) w;
+            fraction[1][i] = (real) w;
         }
     }
     else {
         for (i = 0; i < SBLIMIT; i++) {
             unsigned char n = si->allocation[i][0];
-            unsigned char j = si->scalefactor[i][0];
-            assert( j < 64 );
-            assert( n < 16 );
+            int     w = 0;
             if (n > 0) {
-                unsigned short v = get_leq_16_bits(mp, n + 1);
-                r0 = (((-1) << n) + v + 1) * muls[n + 1][j];
+                unsigned int v = bitreader_get(&br, n + 1);
+                w = ((-1) << n) + v + 1;
             }
-            else {
-                r0 = 0;
-            }
-            fraction[0][i] = (real)r0;
+            fraction[0][i] = (real) w;
         }
-        for (i = ds_limit; i < SBLIMIT; i++) {
-            fraction[0][i] = 0.0;
+    }
+    bitreader_done(&br, mp);
+
+    /* scale[] is 0 above down_sample_sblimit */
+    for (ch = 0; ch < fr->stereo; ch++) {
+        real *const f = fraction[ch];
+        real const *const s = si->scale[ch];
+        for (i = 0; i < SBLIMIT; i++) {
+            f[i] *= s[i];
         }
     }
 }
@@ -213,14 +213,29 @@ II_step_one(PMPSTR mp, sideinfo_layer_II *si, struct frame *fr)
     }
 }
 
+/*
+ * Dequantize one triple of samples per subband and channel.
+ *
+ * The first pass reads the bitstream. It leaves the signed level of an
+ * ungrouped sample in fraction[] and its step size in scale[]; for grouped
+ * samples the value comes straight from muls[] and the scale is 1.
+ * The second pass multiplies the two over whole subband rows, which the
+ * compiler turns into SIMD code. A product of a 16 bit level and a float
+ * needs up to 40 bits, so it is exact in double but not in float.  The
+ * former version rounded that exact double product once to float, which
+ * is what a float multiply does, so the output matches bit for bit.
+ */
 static void
 II_step_two(PMPSTR mp, sideinfo_layer_II* si, struct frame *fr, int gr, real fraction[2][4][SBLIMIT])
 {
     struct al_table2 const *alloc1 = fr->alloc;
     int     sblimit = fr->II_sblimit;
     int     jsbound = (fr->mode == MPG_MD_JOINT_STEREO) ? (fr->mode_ext << 2) + 4 : fr->II_sblimit;
-    int     i, ch, nch = fr->stereo;
-    double  cm, r0, r1, r2;
+    int     i, j, ch, nch = fr->stereo;
+    real    scale[2][SBLIMIT];
+    bitreader_t br;
+
+    bitreader_init(&br, mp);
 
     for (i = 0; i < jsbound; ++i) {
         short   step = alloc1->bits;
@@ -236,30 +251,26 @@ II_step_two(PMPSTR mp, sideinfo_layer_II* si, struct frame *fr, int gr, real fra
                 assert( x1 < 64 );
                 x1 = (x1 < 64) ? x1 : 63;
                 if (d1 < 0) {
-                    int v0 = getbits(mp, k);
-                    int v1 = getbits(mp, k);
-                    int v2 = getbits(mp, k);
-                    cm = muls[k][x1];
-                    r0 = (v0 + d1) * cm;
-                    r1 = (v1 + d1) * cm;
-                    r2 = (v2 + d1) * cm;
+                    int v0 = bitreader_get(&br, k);
+                    int v1 = bitreader_get(&br, k);
+                    int v2 = bitreader_get(&br, k);
+                    fraction[ch][0][i] = (real) (v0 + d1);
+                    fraction[ch][1][i] = (real) (v1 + d1);
+                    fraction[ch][2][i] = (real) (v2 + d1);
+                    scale[ch][i] = muls[k][x1];
                 }
                 else {
-                    unsigned int idx = getbits(mp, k);
+                    unsigned int idx = bitreader_get(&br, k);
                     unsigned char *tab = grp_table_select(d1, idx);
-                    unsigned char k0 = tab[0];
-                    unsigned char k1 = tab[1];
-                    unsigned char k2 = tab[2];
-                    r0 = muls[k0][x1];
-                    r1 = muls[k1][x1];
-                    r2 = muls[k2][x1];
+                    fraction[ch][0][i] = muls[tab[0]][x1];
+                    fraction[ch][1][i] = muls[tab[1]][x1];
+                    fraction[ch][2][i] = muls[tab[2]][x1];
+                    scale[ch][i] = 1;
                 }
-                fraction[ch][0][i] = (real) r0;
-                fraction[ch][1][i] = (real) r1;
-                fraction[ch][2][i] = (real) r2;
             }
             else {
                 fraction[ch][0][i] = fraction[ch][1][i] = fraction[ch][2][i] = 0.0;
+                scale[ch][i] = 0;
             }
         }
         alloc1 += ((size_t)1 << step);
@@ -275,24 +286,21 @@ II_step_two(PMPSTR mp, sideinfo_layer_II* si, struct frame *fr, int gr, real fra
             assert( k <= 16 );
             k = (k <= 16) ? k : 16;
             if (d1 < 0) {
-                int v0 = getbits(mp, k);
-                int v1 = getbits(mp, k);
-                int v2 = getbits(mp, k);
+                int v0 = bitreader_get(&br, k);
+                int v1 = bitreader_get(&br, k);
+                int v2 = bitreader_get(&br, k);
                 for (ch = 0; ch < nch; ++ch) {
                     unsigned char x1 = si->scalefactor[i][ch][gr];
                     assert( x1 < 64 );
                     x1 = (x1 < 64) ? x1 : 63;
-                    cm = muls[k][x1];
-                    r0 = (v0 + d1) * cm;
-                    r1 = (v1 + d1) * cm;
-                    r2 = (v2 + d1) * cm;
-                    fraction[ch][0][i] = (real) r0;
-                    fraction[ch][1][i] = (real) r1;
-                    fraction[ch][2][i] = (real) r2;
+                    fraction[ch][0][i] = (real) (v0 + d1);
+                    fraction[ch][1][i] = (real) (v1 + d1);
+                    fraction[ch][2][i] = (real) (v2 + d1);
+                    scale[ch][i] = muls[k][x1];
                 }
             }
             else {
-                unsigned int idx = getbits(mp, k);
+                unsigned int idx = bitreader_get(&br, k);
                 unsigned char *tab = grp_table_select(d1, idx);
                 unsigned char k0 = tab[0];
                 unsigned char k1 = tab[1];
@@ -301,27 +309,41 @@ II_step_two(PMPSTR mp, sideinfo_layer_II* si, struct frame *fr, int gr, real fra
                     unsigned char x1 = si->scalefactor[i][ch][gr];
                     assert( x1 < 64 );
                     x1 = (x1 < 64) ? x1 : 63;
-                    r0 = muls[k0][x1];
-                    r1 = muls[k1][x1];
-                    r2 = muls[k2][x1];
-                    fraction[ch][0][i] = (real) r0;
-                    fraction[ch][1][i] = (real) r1;
-                    fraction[ch][2][i] = (real) r2;
+                    fraction[ch][0][i] = muls[k0][x1];
+                    fraction[ch][1][i] = muls[k1][x1];
+                    fraction[ch][2][i] = muls[k2][x1];
+                    scale[ch][i] = 1;
                 }
             }
         }
         else {
-            fraction[0][0][i] = fraction[0][1][i] = fraction[0][2][i] = 0.0;
-            fraction[1][0][i] = fraction[1][1][i] = fraction[1][2][i] = 0.0;
+            for (ch = 0; ch < nch; ++ch) {
+                fraction[ch][0][i] = fraction[ch][1][i] = fraction[ch][2][i] = 0.0;
+                scale[ch][i] = 0;
+            }
         }
         alloc1 += ((size_t)1 << step);
     }
+
+    bitreader_done(&br, mp);
+
     if (sblimit > fr->down_sample_sblimit) {
         sblimit = fr->down_sample_sblimit; 
     }
     for (ch = 0; ch < nch; ++ch) {
         for (i = sblimit; i < SBLIMIT; ++i) {
             fraction[ch][0][i] = fraction[ch][1][i] = fraction[ch][2][i] = 0.0;
+            scale[ch][i] = 0;
+        }
+    }
+
+    for (ch = 0; ch < nch; ++ch) {
+        for (j = 0; j < 3; ++j) {
+            real *const f = fraction[ch][j];
+            real const *const s = scale[ch];
+            for (i = 0; i < SBLIMIT; ++i) {
+                f[i] *= s[i];
+            }
         }
     }
 }
@@ -704,32 +704,117 @@ static const int pretab2 [22] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
 /* *INDENT-ON* */
 
 /*
- * don't forget to apply the same changes to III_dequantize_sample_ms() !!!
+ * Huffman decoding of one granule, the first pass of the dequantization.
+ * Writes the lines of the big_values regions and of the count1 region in
+ * bitstream order to xv[], each as its signed |x|^(4/3); the scalefactor
+ * gains are applied in a second pass by III_dequantize_sample(). Returns
+ * the number of lines decoded, *last is one past the last nonzero line.
  */
+static int
+III_huffman_decode(PMPSTR mp, struct gr_info_s const *gr_infos, int const *l, int nregions,
+                   int l3, real xv[SBLIMIT * SSLIMIT], int *part2remain, int *last)
+{
+    int     remain = *part2remain;
+    int     i, n = 0, nz = 0;
+
+    for (i = 0; i < nregions; i++) {
+        int     lp = l[i];
+        struct newhuff const *h = (struct newhuff const *) (ht + gr_infos->table_select[i]);
+
+        for (; lp; lp--) {
+            int     x, y;
+            {
+                short const *val = (short const *) h->table;
+                while ((y = *val++) < 0) {
+                    if (get1bit(mp))
+                        val -= y;
+                    remain--;
+                }
+                x = y >> 4;
+                y &= 0xf;
+            }
+            if (x == 15) {
+                remain -= h->linbits + 1;
+                x += getbits(mp, (int) h->linbits);
+                xv[n] = get1bit(mp) ? -ispow[x] : ispow[x];
+                nz = n + 1;
+            }
+            else if (x) {
+                xv[n] = get1bit(mp) ? -ispow[x] : ispow[x];
+                nz = n + 1;
+                remain--;
+            }
+            else
+                xv[n] = 0.0;
+            n++;
+
+            if (y == 15) {
+                remain -= h->linbits + 1;
+                y += getbits(mp, (int) h->linbits);
+                xv[n] = get1bit(mp) ? -ispow[y] : ispow[y];
+                nz = n + 1;
+            }
+            else if (y) {
+                xv[n] = get1bit(mp) ? -ispow[y] : ispow[y];
+                nz = n + 1;
+                remain--;
+            }
+            else
+                xv[n] = 0.0;
+            n++;
+        }
+    }
+
+    for (; l3 && (remain > 0); l3--) {
+        struct newhuff const *h = (struct newhuff const *) (htc + gr_infos->count1table_select);
+        short const *val = (short const *) h->table;
+        short   a;
+
+        while ((a = *val++) < 0) {
+            remain--;
+            if (remain < 0) {
+                remain++;
+                a = 0;
+                break;
+            }
+            if (get1bit(mp))
+                val -= a;
+        }
+        for (i = 0; i < 4; i++) {
+            if ((a & (0x8 >> i))) {
+                /* a value cut off by part2_3_length still counts for maxband */
+                nz = n + 1;
+                remain--;
+                if (remain < 0) {
+                    remain++;
+                    break;
+                }
+                xv[n] = get1bit(mp) ? -1.0 : 1.0;
+            }
+            else
+                xv[n] = 0.0;
+            n++;
+        }
+    }
+
+    *part2remain = remain;
+    *last = nz;
+    return n;
+}
+
 static int
 III_dequantize_sample(PMPSTR mp, real xr[SBLIMIT][SSLIMIT], int *scf,
                       struct gr_info_s *gr_infos, int sfreq, int part2bits)
 {
     int     shift = 1 + gr_infos->scalefac_scale;
     real   *xrpnt = (real *) xr;
-    int     l[3], l3;
+    real    xv[SBLIMIT * SSLIMIT];
+    int     l[3], l3, n, last;
     int     part2remain = gr_infos->part2_3_length - part2bits;
-    int    *me;
 
     /* lame_report_fnc(mp->report_dbg,"part2remain = %d, gr_infos->part2_3_length = %d, part2bits = %d\n",
        part2remain, gr_infos->part2_3_length, part2bits); */
 
-    {
-        int     i;
-
-        for (i = (&xr[SBLIMIT][0] - xrpnt) >> 1; i > 0; i--) {
-            *xrpnt++ = 0.0;
-            *xrpnt++ = 0.0;
-        }
-
-        xrpnt = (real *) xr;
-    }
-
     {
         int     bv = gr_infos->big_values;
         int     region1 = gr_infos->region1start;
@@ -769,14 +854,17 @@ III_dequantize_sample(PMPSTR mp, real xr[SBLIMIT][SSLIMIT], int *scf,
     }
     /* end MDH crash fix */
 
+    /* short blocks have no third big_values region */
+    n = III_huffman_decode(mp, gr_infos, l, gr_infos->block_type == 2 ? 2 : 3, l3, xv,
+                           &part2remain, &last);
+
     if (gr_infos->block_type == 2) {
         /*
          * decoding with short or mixed mode BandIndex table 
          */
-        int     i, max[4];
-        int     step = 0, lwin = 0, cb = 0;
-        real    v = 0.0;
-        int    *m, mc;
+        int     max[4];
+        int     s = 0;
+        int    *m, *me;
 
         if (gr_infos->mixed_block_flag) {
             max[3] = -1;
@@ -791,149 +879,40 @@ III_dequantize_sample(PMPSTR mp, real xr[SBLIMIT][SSLIMIT], int *scf,
             me = mapend[sfreq][1];
         }
 
-        mc = 0;
-        for (i = 0; i < 2; i++) {
-            int     lp = l[i];
-            struct newhuff const *h = (struct newhuff const *) (ht + gr_infos->table_select[i]);
-            for (; lp; lp--, mc--) {
-                int     x, y;
-                if ((!mc)) {
-                    mc = *m++;
-                    xrpnt = ((real *) xr) + (*m++);
-                    lwin = *m++;
-                    cb = *m++;
-                    if (lwin == 3) {
-                        v = gr_infos->pow2gain[(*scf++) << shift];
-                        step = 1;
-                    }
-                    else {
-                        v = gr_infos->full_gain[lwin][(*scf++) << shift];
-                        step = 3;
-                    }
-                }
-                {
-                    short const *val = (short const *) h->table;
-                    while ((y = *val++) < 0) {
-                        if (get1bit(mp))
-                            val -= y;
-                        part2remain--;
-                    }
-                    x = y >> 4;
-                    y &= 0xf;
-                }
-                if (x == 15) {
-                    max[lwin] = cb;
-                    part2remain -= h->linbits + 1;
-                    x += getbits(mp, (int) h->linbits);
-                    if (get1bit(mp))
-                        *xrpnt = -ispow[x] * v;
-                    else
-                        *xrpnt = ispow[x] * v;
-                }
-                else if (x) {
-                    max[lwin] = cb;
-                    if (get1bit(mp))
-                        *xrpnt = -ispow[x] * v;
-                    else
-                        *xrpnt = ispow[x] * v;
-                    part2remain--;
-                }
-                else
-                    *xrpnt = 0.0;
-                xrpnt += step;
-                if (y == 15) {
-                    max[lwin] = cb;
-                    part2remain -= h->linbits + 1;
-                    y += getbits(mp, (int) h->linbits);
-                    if (get1bit(mp))
-                        *xrpnt = -ispow[y] * v;
-                    else
-                        *xrpnt = ispow[y] * v;
-                }
-                else if (y) {
-                    max[lwin] = cb;
-                    if (get1bit(mp))
-                        *xrpnt = -ispow[y] * v;
-                    else
-                        *xrpnt = ispow[y] * v;
-                    part2remain--;
-                }
-                else
-                    *xrpnt = 0.0;
-                xrpnt += step;
-            }
-        }
-        for (; l3 && (part2remain > 0); l3--) {
-            struct newhuff const *h = (struct newhuff const *) (htc + gr_infos->count1table_select);
-            short const *val = (short const *) h->table;
-            short   a;
-
-            while ((a = *val++) < 0) {
-                part2remain--;
-                if (part2remain < 0) {
-                    part2remain++;
-                    a = 0;
-                    break;
-                }
-                if (get1bit(mp))
-                    val -= a;
-            }
-            for (i = 0; i < 4; i++) {
-                if (!(i & 1)) {
-                    if (!mc) {
-                        mc = *m++;
-                        xrpnt = ((real *) xr) + (*m++);
-                        lwin = *m++;
-                        cb = *m++;
-                        if (lwin == 3) {
-                            v = gr_infos->pow2gain[(*scf++) << shift];
-                            step = 1;
-                        }
-                        else {
-                            v = gr_infos->full_gain[lwin][(*scf++) << shift];
-                            step = 3;
-                        }
-                    }
-                    mc--;
-                }
-                if ((a & (0x8 >> i))) {
-                    max[lwin] = cb;
-                    part2remain--;
-                    if (part2remain < 0) {
-                        part2remain++;
-                        break;
-                    }
-                    if (get1bit(mp))
-                        *xrpnt = -v;
-                    else
-                        *xrpnt = v;
-                }
-                else
-                    *xrpnt = 0.0;
-                xrpnt += step;
-            }
-        }
-
+        /*
+         * one map entry per band and window, the lines of a short
+         * window are interleaved with the other two
+         */
         while (m < me) {
-            if (!mc) {
-                mc = *m++;
-                xrpnt = ((real *) xr) + *m++;
-                if ((*m++) == 3)
-                    step = 1;
+            int     w = 2 * *m++;
+            real   *xp = ((real *) xr) + *m++;
+            int     lwin = *m++;
+            int     cb = *m++;
+            int     step = lwin == 3 ? 1 : 3;
+            int     e = n - s, j;
+            int     nonzero = (s < last && last <= s + w);
+
+            if (e > w)
+                e = w;
+            if (e > 0) {
+                real    v;
+
+                if (lwin == 3)
+                    v = gr_infos->pow2gain[(*scf++) << shift];
                 else
-                    step = 3;
-                m++;    /* cb */
+                    v = gr_infos->full_gain[lwin][(*scf++) << shift];
+                for (j = 0; j < e; j++) {
+                    xp[j * step] = xv[s + j] * v;
+                    nonzero |= (xv[s + j] != 0.0);
+                }
             }
-            mc--;
-            *xrpnt = 0.0;
-            xrpnt += step;
-            *xrpnt = 0.0;
-            xrpnt += step;
-/* we could add a little opt. here:
- * if we finished a band for window 3 or a long band
- * further bands could copied in a simple loop without a
- * special 'map' decoding
- */
+            else
+                e = 0;
+            if (nonzero)
+                max[lwin] = cb;
+            for (j = e; j < w; j++)
+                xp[j * step] = 0.0;
+            s += w;
         }
 
         gr_infos->maxband[0] = max[0] + 1;
@@ -953,130 +932,27 @@ III_dequantize_sample(PMPSTR mp, real xr[SBLIMIT][SSLIMIT], int *scf,
          * decoding with 'long' BandIndex table (block_type != 2)
          */
         int const *pretab = (int const *) (gr_infos->preflag ? pretab1 : pretab2);
-        int     i, max = -1;
-        int     cb = 0;
+        int     i, s, max = -1;
         int    *m = map[sfreq][2];
-        real    v = 0.0;
-        int     mc = 0;
-
-        /*
-         * long hash table values
-         */
-        for (i = 0; i < 3; i++) {
-            int     lp = l[i];
-            struct newhuff const *h = (struct newhuff const *) (ht + gr_infos->table_select[i]);
-
-            for (; lp; lp--, mc--) {
-                int     x, y;
-
-                if (!mc) {
-                    mc = *m++;
-                    v = gr_infos->pow2gain[((*scf++) + (*pretab++)) << shift];
-                    cb = *m++;
-                }
-                {
-                    short const *val = (short const *) h->table;
-                    while ((y = *val++) < 0) {
-                        if (get1bit(mp))
-                            val -= y;
-                        part2remain--;
-                    }
-                    x = y >> 4;
-                    y &= 0xf;
-                }
-                if (x == 15) {
-                    max = cb;
-                    part2remain -= h->linbits + 1;
-                    x += getbits(mp, (int) h->linbits);
-                    if (get1bit(mp))
-                        *xrpnt++ = -ispow[x] * v;
-                    else
-                        *xrpnt++ = ispow[x] * v;
-                }
-                else if (x) {
-                    max = cb;
-                    if (get1bit(mp))
-                        *xrpnt++ = -ispow[x] * v;
-                    else
-                        *xrpnt++ = ispow[x] * v;
-                    part2remain--;
-                }
-                else
-                    *xrpnt++ = 0.0;
-
-                if (y == 15) {
-                    max = cb;
-                    part2remain -= h->linbits + 1;
-                    y += getbits(mp, (int) h->linbits);
-                    if (get1bit(mp))
-                        *xrpnt++ = -ispow[y] * v;
-                    else
-                        *xrpnt++ = ispow[y] * v;
-                }
-                else if (y) {
-                    max = cb;
-                    if (get1bit(mp))
-                        *xrpnt++ = -ispow[y] * v;
-                    else
-                        *xrpnt++ = ispow[y] * v;
-                    part2remain--;
-                }
-                else
-                    *xrpnt++ = 0.0;
-            }
-        }
 
-        /*
-         * short (count1table) values
-         */
-        for (; l3 && (part2remain > 0); l3--) {
-            struct newhuff const *h = (struct newhuff const *) (htc + gr_infos->count1table_select);
-            short const *val = (short const *) h->table;
-            short   a;
-
-            while ((a = *val++) < 0) {
-                part2remain--;
-                if (part2remain < 0) {
-                    part2remain++;
-                    a = 0;
-                    break;
-                }
-                if (get1bit(mp))
-                    val -= a;
-            }
-            for (i = 0; i < 4; i++) {
-                if (!(i & 1)) {
-                    if (!mc) {
-                        mc = *m++;
-                        cb = *m++;
-                        v = gr_infos->pow2gain[((*scf++) + (*pretab++)) << shift];
-                    }
-                    mc--;
-                }
-                if ((a & (0x8 >> i))) {
-                    max = cb;
-                    part2remain--;
-                    if (part2remain < 0) {
-                        part2remain++;
-                        break;
-                    }
-                    if (get1bit(mp))
-                        *xrpnt++ = -v;
-                    else
-                        *xrpnt++ = v;
-                }
-                else
-                    *xrpnt++ = 0.0;
-            }
+        for (s = 0; s < n || s < last;) {
+            int     w = 2 * *m++;
+            int     cb = *m++;
+            int     e = n - s < w ? n - s : w;
+            real    v = gr_infos->pow2gain[((*scf++) + (*pretab++)) << shift];
+
+            if (s < last)
+                max = cb;
+            for (i = 0; i < e; i++)
+                xrpnt[s + i] = xv[s + i] * v;
+            s += w;
         }
 
         /* 
          * zero part
          */
-        for (i = (&xr[SBLIMIT][0] - xrpnt) >> 1; i; i--) {
-            *xrpnt++ = 0.0;
-            *xrpnt++ = 0.0;
-        }
+        for (i = n; i < SBLIMIT * SSLIMIT; i++)
+            xrpnt[i] = 0.0;
 
         gr_infos->maxbandl = max + 1;
         gr_infos->maxb = longLimit[sfreq][gr_infos->maxbandl];
@@ -1096,6 +972,44 @@ III_dequantize_sample(PMPSTR mp, real xr[SBLIMIT][SSLIMIT], int *scf,
 }
 
 
+/*
+ * M/S stereo: mid and side of n lines to left and right
+ */
+static void
+III_ms_stereo(real *xr0, real *xr1, int n)
+{
+    int     i;
+    for (i = 0; i < n; i++) {
+        real    tmp0 = xr0[i], tmp1 = xr1[i];
+        xr1[i] = tmp0 - tmp1;
+        xr0[i] = tmp0 + tmp1;
+    }
+}
+
+/*
+ * intensity stereo of n lines, step apart: both channels are scaled
+ * copies of the left one
+ */
+static void
+III_i_stereo_lines(real *xr0, real *xr1, int n, int step, real t1, real t2)
+{
+    int     i;
+    if (step == 1) {
+        for (i = 0; i < n; i++) {
+            real    v = xr0[i];
+            xr0[i] = v * t1;
+            xr1[i] = v * t2;
+        }
+    }
+    else {
+        for (i = 0; i < n; i++) {
+            real    v = xr0[i * step];
+            xr0[i * step] = v * t1;
+            xr1[i * step] = v * t2;
+        }
+    }
+}
+
 /* 
  * III_stereo: calculate real channel values for Joint-I-Stereo-mode
  */
@@ -1148,11 +1062,7 @@ III_i_stereo(real xr_buf[2][SBLIMIT][SSLIMIT], int *scalefac,
                     idx = bi->shortIdx[sfb] + lwin;
                     t1 = tabl1[is_p];
                     t2 = tabl2[is_p];
-                    for (; sb > 0; sb--, idx += 3) {
-                        real    v = xr[0][idx];
-                        xr[0][idx] = v * t1;
-                        xr[1][idx] = v * t2;
-                    }
+                    III_i_stereo_lines(&xr[0][idx], &xr[1][idx], sb, 3, t1, t2);
                 }
             }
 
@@ -1171,11 +1081,7 @@ maybe still wrong??? (copy 12 to 13?) */
                 real    t1, t2;
                 t1 = tabl1[is_p];
                 t2 = tabl2[is_p];
-                for (; sb > 0; sb--, idx += 3) {
-                    real    v = xr[0][idx];
-                    xr[0][idx] = v * t1;
-                    xr[1][idx] = v * t2;
-                }
+                III_i_stereo_lines(&xr[0][idx], &xr[1][idx], sb, 3, t1, t2);
             }
         }               /* end for(lwin; .. ; . ) */
 
@@ -1193,14 +1099,9 @@ maybe still wrong??? (copy 12 to 13?) */
                     real    t1, t2;
                     t1 = tabl1[is_p];
                     t2 = tabl2[is_p];
-                    for (; sb > 0; sb--, idx++) {
-                        real    v = xr[0][idx];
-                        xr[0][idx] = v * t1;
-                        xr[1][idx] = v * t2;
-                    }
+                    III_i_stereo_lines(&xr[0][idx], &xr[1][idx], sb, 1, t1, t2);
                 }
-                else
-                    idx += sb;
+                idx += sb;
             }
         }
     }
@@ -1215,27 +1116,15 @@ maybe still wrong??? (copy 12 to 13?) */
                 real    t1, t2;
                 t1 = tabl1[is_p];
                 t2 = tabl2[is_p];
-                for (; sb > 0; sb--, idx++) {
-                    real    v = xr[0][idx];
-                    xr[0][idx] = v * t1;
-                    xr[1][idx] = v * t2;
-                }
+                III_i_stereo_lines(&xr[0][idx], &xr[1][idx], sb, 1, t1, t2);
             }
-            else
-                idx += sb;
+            idx += sb;
         }
 
         is_p = scalefac[20]; /* copy l-band 20 to l-band 21 */
-        if (is_p != 7) {
-            int     sb;
-            real    t1 = tabl1[is_p], t2 = tabl2[is_p];
-
-            for (sb = bi->longDiff[21]; sb > 0; sb--, idx++) {
-                real    v = xr[0][idx];
-                xr[0][idx] = v * t1;
-                xr[1][idx] = v * t2;
-            }
-        }
+        if (is_p != 7)
+            III_i_stereo_lines(&xr[0][idx], &xr[1][idx], bi->longDiff[21], 1,
+                               tabl1[is_p], tabl2[is_p]);
     }                   /* ... */
 }
 
@@ -1739,14 +1628,11 @@ decode_layer3_frame(PMPSTR mp, unsigned char *pcm_sample, int *pcm_point,
                 return clip;
 
             if (ms_stereo) {
-                int     i;
-                for (i = 0; i < SBLIMIT * SSLIMIT; i++) {
-                    real    tmp0, tmp1;
-                    tmp0 = ((real *) hybridIn[0])[i];
-                    tmp1 = ((real *) hybridIn[1])[i];
-                    ((real *) hybridIn[1])[i] = tmp0 - tmp1;
-                    ((real *) hybridIn[0])[i] = tmp0 + tmp1;
-                }
+                /* both channels are zero above their maxb */
+                unsigned maxb = mp->sideinfo.ch[0].gr[gr].maxb;
+                if (gr_infos->maxb > maxb)
+                    maxb = gr_infos->maxb;
+                III_ms_stereo((real *) hybridIn[0], (real *) hybridIn[1], SSLIMIT * (int) maxb);
             }
 
             if (i_stereo)
@@ -31,6 +31,8 @@ typedef struct plotting_data plotting_data;
 
 
 extern void lame_report_fnc(lame_report_function f, const char *format, ...);
+extern int lame_once_begin(int volatile *state);
+extern void lame_once_end(int volatile *state);
 
 struct buf {
     unsigned char *pnt;
@@ -72,6 +74,7 @@ typedef struct mpstr_tag {
     real    hybrid_block[2][2][SBLIMIT * SSLIMIT];
     int     hybrid_blc[2];
     unsigned long header;
+    unsigned long fr_head;   /* header fr was decoded from, 0 = none */
     int     bsnum;
     real    synth_buffs[2][2][0x110];
     int     synth_bo;
@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include "tabinit.h"
 #include "mpg123.h"
+#include "mpglib.h"
 
 #ifdef WITH_DMALLOC
 #include <dmalloc.h>
@@ -109,12 +110,19 @@ static const double dewin[512] = {
 };
 /* *INDENT-ON* */
 
+static int volatile gd_decode_tables_init = 0;
+
 void
 make_decode_tables(long scaleval)
 {
     int     i, j, k, kr, divv;
     real   *table, *costab;
 
+    /* the tables are global, shared by all decoders of the process,
+     * and built only once, with the scale of the first call */
+    if (!lame_once_begin(&gd_decode_tables_init)) {
+        return;
+    }
 
     for (i = 0; i < 5; i++) {
         kr = 0x10 >> i;
@@ -143,4 +151,6 @@ make_decode_tables(long scaleval)
         if (i % 64 == 63)
             scaleval = -scaleval;
     }
+
+    lame_once_end(&gd_decode_tables_init);
 }
@@ -17,9 +17,43 @@
 // Free Software Foundation, Inc., 59 Temple Place - Suite 330,
 // Boston, MA 02111-1307, USA.
 
+// Usage:
+//   lame_test <filename> <number pcm samples>          (Windows)
+//   lame_test matrix [-j threads] [-r runs] [-t percent] [-g golden] [-o manifest]
+//             input.wav options_file...
+//
+// The matrix mode encodes input.wav once for every line of the option
+// files (test/*.op, the same files lametest.py uses) in process, on a
+// pool of threads, and prints one manifest line per option line:
+//
+//   <fnv-1a 64 of the mp3> <bytes> <seconds> <options>
+//
+// With -g the results are checked against a manifest written earlier
+// with -o: a different hash is a bit change, an encode more than
+// -t percent (default 20) slower is a speed regression, and an option
+// line the manifest does not have is missing. Any of them makes the
+// exit code 1; a manifest that can't be read, 2. Speeds are only
+// comparable for the same -j;
+// -r runs each encode that many times (default 3) and keeps the fastest.
+//
+// Build (C++11 for the thread pool), e.g. from the top directory:
+//   g++ -O2 -std=c++11 -Iinclude test/lame_test.cpp libmp3lame/.libs/libmp3lame.a
+//       -lm -lpthread -o lame_test
+
 #include <lame.h>
 #include <wchar.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 
 class PcmGenerator
@@ -73,6 +107,7 @@ public:
   }
 };
 
+#ifdef _WIN32
 class OutFile
 {
   FILE* m_file_handle;
@@ -109,6 +144,8 @@ public:
   }
 };
 
+#endif
+
 class Lame
 {
   lame_t m_gf;
@@ -218,6 +255,7 @@ public:
   unsigned char* begin()   { return m_data; }
 };
 
+#ifdef _WIN32
 void generateFile(wchar_t const* filename, size_t n)
 {
   int const chunk = 1152;
@@ -264,8 +302,385 @@ void generateFile(wchar_t const* filename, size_t n)
   lame.close();
 }
 
+#endif
+
+// ---------------------------------------------------------------------
+// option matrix
+
+class WavFile
+{
+  std::vector<short> m_pcm;
+  int m_channels;
+  int m_samplerate;
+
+  static unsigned long le(unsigned char const* p, int n) {
+    unsigned long v = 0;
+    while (n--) v = (v << 8) | p[n];
+    return v;
+  }
+
+public:
+  WavFile()
+    : m_channels(0)
+    , m_samplerate(0)
+  {}
+
+  // 16 bit PCM only, like testcase.wav
+  bool read(char const* filename) {
+    FILE* f = fopen(filename, "rb");
+    if (f == 0) return false;
+    unsigned char head[12];
+    bool ok = fread(head, 1, 12, f) == 12
+           && memcmp(head, "RIFF", 4) == 0 && memcmp(head + 8, "WAVE", 4) == 0;
+    int bits = 0;
+    while (ok) {
+      unsigned char chunk[8];
+      if (fread(chunk, 1, 8, f) != 8) { ok = false; break; }
+      unsigned long const size = le(chunk + 4, 4);
+      if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+        unsigned char fmt[16];
+        ok = fread(fmt, 1, 16, f) == 16 && fseek(f, (long) (size - 16 + (size & 1)), SEEK_CUR) == 0;
+        ok = ok && le(fmt, 2) == 1;
+        m_channels = (int) le(fmt + 2, 2);
+        m_samplerate = (int) le(fmt + 4, 4);
+        bits = (int) le(fmt + 14, 2);
+      }
+      else if (memcmp(chunk, "data", 4) == 0) {
+        ok = bits == 16 && (m_channels == 1 || m_channels == 2);
+        if (ok) {
+          std::vector<unsigned char> raw(size);
+          size_t const n = fread(raw.empty() ? 0 : &raw[0], 1, size, f);
+          m_pcm.resize(n / 2);
+          for (size_t i = 0; i < m_pcm.size(); ++i)
+            m_pcm[i] = (short) (raw[2 * i] | (raw[2 * i + 1] << 8));
+        }
+        break;
+      }
+      else {
+        ok = fseek(f, (long) (size + (size & 1)), SEEK_CUR) == 0;
+      }
+    }
+    fclose(f);
+    return ok && !m_pcm.empty();
+  }
+
+  short const* pcm() const { return &m_pcm[0]; }
+  int channels() const { return m_channels; }
+  int samplerate() const { return m_samplerate; }
+  int frames() const { return (int) (m_pcm.size() / m_channels); }
+  double seconds() const { return (double) frames() / m_samplerate; }
+};
+
+// the options of the *.op files, applied the way frontend/parse.c does.
+// The developer-only switches (--noshort, --notemp, --noath, --athlower)
+// take effect as in a frontend built with INTERNAL_OPTS; a release lame
+// ignores them, so only those lines differ from its output.
+static bool applyOptions(lame_t gf, std::string const& options)
+{
+  std::istringstream in(options);
+  std::vector<std::string> args;
+  std::string arg;
+  while (in >> arg) args.push_back(arg);
+
+  for (size_t i = 0; i < args.size(); ++i) {
+    std::string const& a = args[i];
+    char const* next = i + 1 < args.size() ? args[i + 1].c_str() : "";
+    bool used = true;
+
+    if      (a == "--resample") {
+      double const v = atof(next);
+      lame_set_out_samplerate(gf, (int) (v * (v <= 1000 ? 1000 : 1) + 0.5));
+    }
+    else if (a == "--vbr-old")    { lame_set_VBR(gf, vbr_rh); used = false; }
+    else if (a == "--vbr-new")    { lame_set_VBR(gf, vbr_mt); used = false; }
+    else if (a == "--abr") {
+      int v = atoi(next);
+      if (v >= 8000) v = (v + 500) / 1000;
+      v = std::min(std::max(v, 8), 320);
+      lame_set_VBR(gf, vbr_abr);
+      lame_set_VBR_mean_bitrate_kbps(gf, v);
+    }
+    else if (a == "--nores")      { lame_set_disable_reservoir(gf, 1); used = false; }
+    else if (a == "--scale")      lame_set_scale(gf, (float) atof(next));
+    else if (a == "--noasm") {
+      if (!strcmp(next, "mmx"))   lame_set_asm_optimizations(gf, MMX, 0);
+      if (!strcmp(next, "3dnow")) lame_set_asm_optimizations(gf, AMD_3DNOW, 0);
+      if (!strcmp(next, "sse"))   lame_set_asm_optimizations(gf, SSE, 0);
+    }
+    else if (a == "--freeformat") { lame_set_free_format(gf, 1); used = false; }
+    else if (a == "--lowpass") {
+      double const v = atof(next);
+      lame_set_lowpassfreq(gf, v < 0 ? -1 : (int) (v * (v < 50. ? 1.e3 : 1.e0) + 0.5));
+    }
+    else if (a == "--noshort")    { lame_set_no_short_blocks(gf, 1); used = false; }
+    else if (a == "--notemp")     { lame_set_useTemporal(gf, 0); used = false; }
+    else if (a == "--noath")      { lame_set_noATH(gf, 1); used = false; }
+    else if (a == "--athlower")   lame_set_ATHlower(gf, (float) atof(next));
+    else if (a == "-m") {
+      switch (*next) {
+      case 's': lame_set_mode(gf, STEREO); break;
+      case 'd': lame_set_mode(gf, DUAL_CHANNEL); break;
+      case 'f': lame_set_force_ms(gf, 1); /* FALLTHROUGH */
+      case 'j': lame_set_mode(gf, JOINT_STEREO); break;
+      case 'm': lame_set_mode(gf, MONO); break;
+      default: return false;
+      }
+    }
+    else if (a.compare(0, 2, "-V") == 0) {
+      if (lame_get_VBR(gf) == vbr_off)
+        lame_set_VBR(gf, vbr_default);
+      lame_set_VBR_quality(gf, (float) atof(a.size() > 2 ? a.c_str() + 2 : next));
+      used = a.size() == 2;
+    }
+    else if (a.compare(0, 2, "-q") == 0) {
+      lame_set_quality(gf, atoi(a.size() > 2 ? a.c_str() + 2 : next));
+      used = a.size() == 2;
+    }
+    else if (a == "-f")           { lame_set_quality(gf, 7); used = false; }
+    else if (a == "-h")           { lame_set_quality(gf, 2); used = false; }
+    else if (a == "-b") {
+      lame_set_brate(gf, atoi(next));
+      lame_set_VBR_min_bitrate_kbps(gf, lame_get_brate(gf));
+    }
+    else if (a == "-B")           lame_set_VBR_max_bitrate_kbps(gf, atoi(next));
+    else if (a == "-F")           { lame_set_VBR_hard_min(gf, 1); used = false; }
+    else if (a == "-t")           { lame_set_bWriteVbrTag(gf, 0); used = false; }
+    else if (a == "-p")           { lame_set_error_protection(gf, 1); used = false; }
+    else if (a == "-k")           used = false; /* obsolete, ignored by the frontend too */
+    else return false;
+
+    if (used) {
+      if (i + 1 >= args.size()) return false;
+      ++i;
+    }
+  }
+  return true;
+}
+
+static unsigned long long fnv1a(unsigned char const* p, size_t n)
+{
+  unsigned long long h = 14695981039346656037ULL;
+  while (n--) {
+    h ^= *p++;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+struct MatrixJob
+{
+  std::string options;
+  unsigned long long hash;
+  size_t bytes;
+  double seconds;
+  bool failed;
+};
+
+// encode the whole input with one option line; keeps the fastest of runs
+static void encodeJob(WavFile const& wav, MatrixJob& job, int runs)
+{
+  int const chunk = 1152;
+  job.failed = true;
+  job.seconds = 0;
+
+  for (int run = 0; run < runs; ++run) {
+    Lame lame;
+    if (!lame.isOpen()) return;
+    lame.setInSamplerate(wav.samplerate());
+    lame.setNumChannels(wav.channels());
+    lame_set_findReplayGain(lame, 1); /* the frontend default */
+    if (!applyOptions(lame, job.options)) return;
+
+    std::chrono::steady_clock::time_point const t0 = std::chrono::steady_clock::now();
+    if (lame_init_params(lame) < 0) return;
+
+    std::vector<unsigned char> mp3;
+    size_t used = 0;
+    for (int pos = 0; ; pos += chunk) {
+      int const n = std::min(chunk, wav.frames() - pos);
+      // worst case of lame.h plus room for the flush
+      mp3.resize(used + 5 * chunk / 4 + 7200 + LAME_MAXMP3BUFFER);
+      int const rc = n > 0
+        ? (wav.channels() == 2
+           ? lame_encode_buffer_interleaved(lame, const_cast<short*>(wav.pcm() + 2 * pos), n,
+                                            &mp3[used], (int) (mp3.size() - used))
+           : lame_encode_buffer(lame, wav.pcm() + pos, wav.pcm() + pos, n,
+                                &mp3[used], (int) (mp3.size() - used)))
+        : lame_encode_flush(lame, &mp3[used], (int) (mp3.size() - used));
+      if (rc < 0) return;
+      used += rc;
+      if (n <= 0) break;
+    }
+    size_t const tag = lame_get_lametag_frame(lame, 0, 0);
+    if (tag > 0 && tag <= used)
+      lame_get_lametag_frame(lame, &mp3[0], tag);
+    double const t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    job.hash = fnv1a(used ? &mp3[0] : 0, used);
+    job.bytes = used;
+    if (run == 0 || t < job.seconds) job.seconds = t;
+  }
+  job.failed = false;
+}
+
+static bool readOptionFile(char const* filename, std::vector<MatrixJob>& jobs)
+{
+  FILE* f = fopen(filename, "r");
+  if (f == 0) return false;
+  char line[1024];
+  while (fgets(line, sizeof(line), f)) {
+    std::string s(line);
+    s.erase(s.find_last_not_of(" \t\r\n") + 1);
+    s.erase(0, s.find_first_not_of(" \t"));
+    if (s.empty() || s[0] == '#') continue;
+    bool seen = false;
+    for (size_t i = 0; i < jobs.size() && !seen; ++i) seen = jobs[i].options == s;
+    if (!seen) {
+      MatrixJob job = { s, 0, 0, 0, true };
+      jobs.push_back(job);
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+static bool readManifest(char const* filename, std::map<std::string, MatrixJob>& golden)
+{
+  FILE* f = fopen(filename, "r");
+  if (f == 0) return false;
+  char line[1200];
+  while (fgets(line, sizeof(line), f)) {
+    MatrixJob job;
+    unsigned long bytes = 0;
+    int used = 0;
+    if (sscanf(line, "%llx %lu %lf %n", &job.hash, &bytes, &job.seconds, &used) < 3) continue;
+    job.options = line + used;
+    job.options.erase(job.options.find_last_not_of(" \t\r\n") + 1);
+    job.bytes = bytes;
+    job.failed = false;
+    golden[job.options] = job;
+  }
+  bool const ok = !ferror(f);
+  fclose(f);
+  return ok;
+}
+
+int runMatrix(int argc, char** argv)
+{
+  int threads = (int) std::thread::hardware_concurrency();
+  int runs = 3;
+  double tolerance = 20;
+  char const* golden_name = 0;
+  char const* out_name = 0;
+  int i = 0;
+
+  for (; i < argc && argv[i][0] == '-' && i + 1 < argc; i += 2) {
+    if      (!strcmp(argv[i], "-j")) threads = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "-r")) runs = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "-t")) tolerance = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "-g")) golden_name = argv[i + 1];
+    else if (!strcmp(argv[i], "-o")) out_name = argv[i + 1];
+    else break;
+  }
+  if (argc - i < 2) {
+    fprintf(stderr, "usage: lame_test matrix [-j threads] [-r runs] [-t percent] "
+                    "[-g golden] [-o manifest] input.wav options_file...\n");
+    return 2;
+  }
+  threads = std::max(threads, 1);
+  runs = std::max(runs, 1);
+
+  WavFile wav;
+  if (!wav.read(argv[i])) {
+    fprintf(stderr, "can't read 16 bit PCM WAV %s\n", argv[i]);
+    return 2;
+  }
+  std::vector<MatrixJob> jobs;
+  for (++i; i < argc; ++i) {
+    if (!readOptionFile(argv[i], jobs)) {
+      fprintf(stderr, "can't read option file %s\n", argv[i]);
+      return 2;
+    }
+  }
+  std::map<std::string, MatrixJob> golden;
+  if (golden_name && !readManifest(golden_name, golden)) {
+    fprintf(stderr, "can't read golden manifest %s\n", golden_name);
+    return 2;
+  }
+
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> pool;
+  std::chrono::steady_clock::time_point const t0 = std::chrono::steady_clock::now();
+  for (int t = 0; t < threads; ++t) {
+    pool.push_back(std::thread([&]() {
+      for (size_t k; (k = next++) < jobs.size(); )
+        encodeJob(wav, jobs[k], runs);
+    }));
+  }
+  for (size_t t = 0; t < pool.size(); ++t) pool[t].join();
+  double const wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  FILE* out = out_name ? fopen(out_name, "w") : stdout;
+  if (out == 0) {
+    fprintf(stderr, "can't write %s\n", out_name);
+    return 2;
+  }
+  int failed = 0, changed = 0, slower = 0, missing = 0;
+  double time_now = 0, time_golden = 0;
+  for (size_t k = 0; k < jobs.size(); ++k) {
+    MatrixJob const& job = jobs[k];
+    if (job.failed) {
+      fprintf(stderr, "FAILED  %s\n", job.options.c_str());
+      ++failed;
+      continue;
+    }
+    fprintf(out, "%016llx %lu %.6f %s\n", job.hash, (unsigned long) job.bytes, job.seconds,
+            job.options.c_str());
+    if (!golden_name) continue;
+    std::map<std::string, MatrixJob>::const_iterator g = golden.find(job.options);
+    if (g == golden.end()) {
+      fprintf(stderr, "MISSING %s\n", job.options.c_str());
+      ++missing;
+      continue;
+    }
+    time_now += job.seconds;
+    time_golden += g->second.seconds;
+    if (g->second.hash != job.hash || g->second.bytes != job.bytes) {
+      fprintf(stderr, "BITS    %s (%lu bytes, was %lu)\n", job.options.c_str(),
+              (unsigned long) job.bytes, (unsigned long) g->second.bytes);
+      ++changed;
+    }
+    if (job.seconds > g->second.seconds * (1 + tolerance / 100)) {
+      fprintf(stderr, "SLOWER  %s (%.1fx realtime, was %.1fx)\n", job.options.c_str(),
+              wav.seconds() / job.seconds, wav.seconds() / g->second.seconds);
+      ++slower;
+    }
+  }
+  if (out != stdout) fclose(out);
+
+  fprintf(stderr, "%lu option lines, %d threads, %.2f s", (unsigned long) jobs.size(), threads, wall);
+  if (golden_name)
+    fprintf(stderr, "; %d bit changes, %d slower, %d not in %s; encoding %.2f s, was %.2f s",
+            changed, slower, missing, golden_name, time_now, time_golden);
+  fprintf(stderr, "%s\n", failed ? "; some encodes FAILED" : "");
+  return failed || changed || slower || missing ? 1 : 0;
+}
+
+#ifdef _WIN32
 int wmain(int argc, wchar_t** argv)
 {
+  if (argc >= 2 && wcscmp(argv[1], L"matrix") == 0) {
+    std::vector<std::string> args;
+    std::vector<char*> argp;
+    for (int i = 2; i < argc; ++i) {
+      char buf[1024];
+      size_t const n = wcstombs(buf, argv[i], sizeof(buf) - 1);
+      buf[n == (size_t) -1 ? 0 : n] = 0;
+      args.push_back(buf);
+    }
+    for (size_t i = 0; i < args.size(); ++i) argp.push_back(&args[i][0]);
+    return runMatrix((int) argp.size(), argp.empty() ? 0 : &argp[0]);
+  }
   if (argc != 3) {
     wprintf(L"usage: %ws <filename> <number pcm samples>\n", argv[0]);
     return -1;
@@ -276,3 +691,12 @@ int wmain(int argc, wchar_t** argv)
   generateFile(argv[1], n);
   return 0;
 }
+#else
+int main(int argc, char** argv)
+{
+  if (argc >= 2 && strcmp(argv[1], "matrix") == 0)
+    return runMatrix(argc - 2, argv + 2);
+  fprintf(stderr, "usage: %s matrix [options] input.wav options_file...\n", argv[0]);
+  return 2;
+}
+#endif